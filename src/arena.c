@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+struct _arena_block {
+    struct _arena_block * nxt;
+    size_t size, used;
+    char * data;
+};
+
+struct _arena {
+    struct _arena_block * head;
+    size_t blocksize;
+    size_t total;       // Total size of all blocks
+};
+
+static struct _arena_block * new_block( const size_t size){
+    struct _arena_block * block = malloc(sizeof(*block));
+    validate(NULL!=block,NULL);
+    if( 0!=posix_memalign((void **)&block->data,ARENA_ALIGN,size) ){
+        free(block);
+        return NULL;
+    }
+    block->nxt = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void free_blocks( struct _arena_block * block){
+    while(NULL!=block){
+        struct _arena_block * nxt = block->nxt;
+        free(block->data);
+        free(block);
+        block = nxt;
+    }
+}
+
+ARENA new_ARENA( const size_t blocksize){
+    validate(blocksize>0,NULL);
+    ARENA arena = calloc(1,sizeof(*arena));
+    validate(NULL!=arena,NULL);
+    arena->blocksize = blocksize;
+    return arena;
+}
+
+void free_ARENA( ARENA arena){
+    if(NULL==arena){ return; }
+    free_blocks(arena->head);
+    free(arena);
+}
+
+/* Release all allocations. If more than one block was needed, they are
+ * replaced by a single block large enough for all of them.
+ */
+void reset_ARENA( ARENA arena){
+    validate(NULL!=arena,);
+    if(NULL==arena->head){ return; }
+    if(NULL!=arena->head->nxt){
+        free_blocks(arena->head);
+        arena->head = new_block(arena->total);
+        if(NULL==arena->head){ arena->total = 0; return; }
+    }
+    arena->head->used = 0;
+}
+
+void * alloc_ARENA( ARENA arena, const size_t size){
+    validate(NULL!=arena,NULL);
+    const size_t asize = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN-1);
+    struct _arena_block * block = arena->head;
+    if( NULL==block || block->size-block->used < asize ){
+        const size_t bsize = (asize>arena->blocksize) ? asize : arena->blocksize;
+        block = new_block(bsize);
+        validate(NULL!=block,NULL);
+        block->nxt = arena->head;
+        arena->head = block;
+        arena->total += bsize;
+    }
+    void * ptr = block->data + block->used;
+    block->used += asize;
+    memset(ptr,0,size);
+    return ptr;
+}
+
+char * strdup_ARENA( ARENA arena, const char * str){
+    validate(NULL!=str,NULL);
+    const size_t len = strlen(str);
+    char * cpy = alloc_ARENA(arena,len+1);
+    validate(NULL!=cpy,NULL);
+    memcpy(cpy,str,len+1);
+    return cpy;
+}
+
+/* Matrix whose structure and elements are both in the arena. Must not be
+ * passed to free_MAT.
+ */
+MAT new_MAT_ARENA( ARENA arena, const int nrow, const int ncol){
+    validate(nrow>0 && ncol>0,NULL);
+    MAT mat = alloc_ARENA(arena,sizeof(*mat));
+    validate(NULL!=mat,NULL);
+    mat->x = alloc_ARENA(arena,(size_t)nrow*ncol*sizeof(real_t));
+    validate(NULL!=mat->x,NULL);
+    mat->nrow = nrow;
+    mat->ncol = ncol;
+    return mat;
+}
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "utility.h"
+#include "matrix.h"
+
+/* Region allocator for objects sharing a lifetime, such as everything
+ * belonging to one read. Memory is never freed individually; reset_ARENA
+ * releases everything at once but keeps the memory, so once the arena has
+ * grown to its high-water mark no further calls to malloc are made.
+ * Allocations are aligned to ARENA_ALIGN bytes and zeroed.
+ */
+#define ARENA_ALIGN 32
+
+typedef struct _arena * ARENA;
+
+ARENA new_ARENA( const size_t blocksize);
+void free_ARENA( ARENA arena);
+void reset_ARENA( ARENA arena);
+void * alloc_ARENA( ARENA arena, const size_t size);
+char * strdup_ARENA( ARENA arena, const char * str);
+MAT new_MAT_ARENA( ARENA arena, const int nrow, const int ncol);
+
+// Array of type A from arena
+#define new_ARRAY_ARENA(A,ARENA,N) (ARRAY(A)){ alloc_ARENA((ARENA),(N)*sizeof(A)), (N) }
+
+#endif
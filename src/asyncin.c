@@ -0,0 +1,320 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+#include <zlib.h>
+#include "utility.h"
+#include "pool.h"
+#include "outbuf.h"
+#include "bgzf.h"
+#include "asyncin.h"
+
+#define ASYNCIN_NCHUNK 4
+#define ASYNCIN_CHUNKSIZE (1<<20)
+#define ASYNCIN_INSIZE (1<<18)
+
+struct _asyncin {
+    int fd;
+    bool bgzf;
+    // Compressed input, starting with any prefix given by the caller
+    char * in;
+    size_t incap, inlen, inoff;
+    bool ineof;
+    // Queue of decompressed chunks. Chunks [head,tail) are ready to be read;
+    // chunk tail is being filled by the decompressing thread.
+    OUTBUF chunk[ASYNCIN_NCHUNK];
+    uint64_t head, tail;
+    size_t off;             // Position in chunk head
+    bool finished, stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_ready, cond_free;
+    pthread_t thread;
+    uint32_t nthread;
+};
+
+bool is_gzip_ASYNCIN( const char * buf, const size_t len){
+    return len>=2 && 0x1f==(uint8_t)buf[0] && 0x8b==(uint8_t)buf[1];
+}
+
+/* More compressed input, keeping any unused input. Returns false if there
+ * is none.
+ */
+static bool fill_input( ASYNCIN ain){
+    if(ain->ineof){ return false; }
+    if(ain->inoff>0){
+        memmove(ain->in,ain->in+ain->inoff,ain->inlen-ain->inoff);
+        ain->inlen -= ain->inoff;
+        ain->inoff = 0;
+    }
+    for(;;){
+        const ssize_t ret = read(ain->fd,ain->in+ain->inlen,ain->incap-ain->inlen);
+        if(ret>0){
+            ain->inlen += ret;
+            return true;
+        }
+        if(ret<0 && EINTR==errno){ continue; }
+        if(ret<0){ err(EXIT_FAILURE,"Failed to read compressed input"); }
+        ain->ineof = true;
+        return false;
+    }
+}
+
+/* Exactly len bytes of compressed input. Returns the number available if
+ * input ends first.
+ */
+static size_t read_input( ASYNCIN ain, char * buf, const size_t len){
+    while( ain->inlen-ain->inoff<len && fill_input(ain) );
+    const size_t n = (ain->inlen-ain->inoff<len) ? ain->inlen-ain->inoff : len;
+    memcpy(buf,ain->in+ain->inoff,n);
+    ain->inoff += n;
+    return n;
+}
+
+/* Empty chunk to decompress into, waiting until the reader has finished
+ * with it. NULL if the reader has stopped.
+ */
+static OUTBUF acquire_chunk( ASYNCIN ain){
+    pthread_mutex_lock(&ain->lock);
+    while( ain->tail-ain->head>=ASYNCIN_NCHUNK && !ain->stop ){
+        pthread_cond_wait(&ain->cond_free,&ain->lock);
+    }
+    OUTBUF chunk = ain->stop ? NULL : ain->chunk[ain->tail % ASYNCIN_NCHUNK];
+    pthread_mutex_unlock(&ain->lock);
+    if(NULL!=chunk){ clear_OUTBUF(chunk); }
+    return chunk;
+}
+
+static void publish_chunk( ASYNCIN ain){
+    pthread_mutex_lock(&ain->lock);
+    ain->tail++;
+    pthread_cond_signal(&ain->cond_ready);
+    pthread_mutex_unlock(&ain->lock);
+}
+
+static bool stopped( ASYNCIN ain){
+    pthread_mutex_lock(&ain->lock);
+    const bool stop = ain->stop;
+    pthread_mutex_unlock(&ain->lock);
+    return stop;
+}
+
+/* Serial decompression of gzip members */
+static void inflate_gzip( ASYNCIN ain){
+    z_stream zs = {0};
+    if(Z_OK!=inflateInit2(&zs,15+16)){ errx(EXIT_FAILURE,"Failed to initialise decompression"); }
+    OUTBUF chunk = acquire_chunk(ain);
+    bool ended = false;
+    while( NULL!=chunk ){
+        if(ain->inoff==ain->inlen && !fill_input(ain)){ break; }
+        if(ended){
+            // Another member follows
+            inflateReset(&zs);
+            ended = false;
+        }
+        zs.next_in = (Bytef *)(ain->in+ain->inoff);
+        zs.avail_in = ain->inlen - ain->inoff;
+        zs.next_out = (Bytef *)(chunk->buf+chunk->len);
+        zs.avail_out = ASYNCIN_CHUNKSIZE - chunk->len;
+        const int ret = inflate(&zs,Z_NO_FLUSH);
+        ain->inoff = ain->inlen - zs.avail_in;
+        chunk->len = ASYNCIN_CHUNKSIZE - zs.avail_out;
+        if(Z_STREAM_END==ret){
+            ended = true;
+        } else if(Z_OK!=ret && Z_BUF_ERROR!=ret){
+            errx(EXIT_FAILURE,"Compressed input is corrupt");
+        }
+        if(ASYNCIN_CHUNKSIZE==chunk->len){
+            publish_chunk(ain);
+            chunk = acquire_chunk(ain);
+        }
+    }
+    if(NULL!=chunk && !ended){ errx(EXIT_FAILURE,"Compressed input is truncated"); }
+    if(NULL!=chunk && chunk->len>0){ publish_chunk(ain); }
+    inflateEnd(&zs);
+}
+
+/* A BGZF block to decompress */
+typedef struct {
+    size_t inlen, outlen;
+    char in[BGZF_MAXBLOCK];
+    char out[BGZF_MAXBLOCK];
+} * UNZJOB;
+
+static void * new_UNZJOB( void * info){
+    UNZJOB job = calloc(1,sizeof(*job));
+    validate(NULL!=job,NULL);
+    return job;
+}
+
+static void free_UNZJOB( void * arg){
+    free(arg);
+}
+
+static void work_UNZJOB( void * arg, void * info){
+    UNZJOB job = arg;
+    if(!inflate_BGZF(job->in,job->inlen,job->out,&job->outlen)){
+        errx(EXIT_FAILURE,"Compressed input is corrupt");
+    }
+}
+
+/* Called in order of blocks, so chunk being filled is only used here */
+struct unzinfo {
+    ASYNCIN ain;
+    OUTBUF chunk;
+};
+
+static void write_UNZJOB( void * arg, void * info){
+    UNZJOB job = arg;
+    struct unzinfo * unz = info;
+    if(NULL==unz->chunk){ return; } // Reader has stopped
+    if(unz->chunk->len+job->outlen>ASYNCIN_CHUNKSIZE){
+        publish_chunk(unz->ain);
+        unz->chunk = acquire_chunk(unz->ain);
+        if(NULL==unz->chunk){ return; }
+    }
+    append_OUTBUF(unz->chunk,job->out,job->outlen);
+}
+
+/* Blocks read serially and inflated in parallel */
+static void inflate_bgzf( ASYNCIN ain){
+    struct unzinfo unz = { ain, acquire_chunk(ain) };
+    if(NULL==unz.chunk){ return; }
+    const POOL_FUNCS funcs = { new_UNZJOB, free_UNZJOB, work_UNZJOB, write_UNZJOB };
+    POOL pool = new_POOL(ain->nthread,4*ain->nthread,funcs,&unz);
+    if(NULL==pool){ errx(EXIT_FAILURE,"Failed to create pool of %u threads",ain->nthread); }
+    while(!stopped(ain)){
+        UNZJOB job = next_job_POOL(pool);
+        const size_t n = read_input(ain,job->in,BGZF_HEADER);
+        if(0==n){ break; }
+        job->inlen = (BGZF_HEADER==n) ? blocksize_BGZF(job->in) : 0;
+        if(0==job->inlen){ errx(EXIT_FAILURE,"Compressed input is not BGZF or is truncated"); }
+        const size_t rest = job->inlen - BGZF_HEADER;
+        if(rest!=read_input(ain,job->in+BGZF_HEADER,rest)){
+            errx(EXIT_FAILURE,"Compressed input is truncated");
+        }
+        submit_POOL(pool);
+    }
+    free_POOL(pool);
+    if(NULL!=unz.chunk && unz.chunk->len>0){ publish_chunk(ain); }
+}
+
+static void * decompress_thread( void * arg){
+    ASYNCIN ain = arg;
+    if(ain->bgzf){
+        inflate_bgzf(ain);
+    } else {
+        inflate_gzip(ain);
+    }
+    pthread_mutex_lock(&ain->lock);
+    ain->finished = true;
+    pthread_cond_signal(&ain->cond_ready);
+    pthread_mutex_unlock(&ain->lock);
+    return NULL;
+}
+
+/* Decompress gzip input from fd, prefix being data that has already been
+ * read from it. BGZF blocks are inflated by nthread threads.
+ */
+ASYNCIN new_ASYNCIN( const int fd, const char * prefix, const size_t prefixlen, const uint32_t nthread){
+    validate(fd>=0,NULL);
+    validate(nthread>0,NULL);
+    ASYNCIN ain = calloc(1,sizeof(*ain));
+    validate(NULL!=ain,NULL);
+    ain->fd = fd;
+    ain->nthread = nthread;
+    ain->incap = (prefixlen>ASYNCIN_INSIZE) ? prefixlen : ASYNCIN_INSIZE;
+    ain->in = malloc(ain->incap);
+    if(NULL==ain->in){ goto cleanup; }
+    if(prefixlen>0){ memcpy(ain->in,prefix,prefixlen); }
+    ain->inlen = prefixlen;
+    for ( uint32_t i=0 ; i<ASYNCIN_NCHUNK ; i++){
+        ain->chunk[i] = new_OUTBUF(ASYNCIN_CHUNKSIZE);
+        if(NULL==ain->chunk[i]){ goto cleanup; }
+    }
+    // Type of input decided from first block
+    while( ain->inlen<BGZF_HEADER && fill_input(ain) );
+    ain->bgzf = (ain->inlen>=BGZF_HEADER) && (0!=blocksize_BGZF(ain->in));
+
+    pthread_mutex_init(&ain->lock,NULL);
+    pthread_cond_init(&ain->cond_ready,NULL);
+    pthread_cond_init(&ain->cond_free,NULL);
+    if(0!=pthread_create(&ain->thread,NULL,decompress_thread,ain)){
+        errx(EXIT_FAILURE,"Failed to create decompression thread");
+    }
+    return ain;
+
+cleanup:
+    for ( uint32_t i=0 ; i<ASYNCIN_NCHUNK ; i++){ free_OUTBUF(ain->chunk[i]); }
+    safe_free(ain->in);
+    safe_free(ain);
+    return NULL;
+}
+
+/* Upto len bytes of decompressed input, waiting if none is ready. Returns
+ * zero at the end of input.
+ */
+ssize_t read_ASYNCIN( ASYNCIN ain, char * buf, const size_t len){
+    validate(NULL!=ain,-1);
+    validate(NULL!=buf,-1);
+    pthread_mutex_lock(&ain->lock);
+    while( ain->head==ain->tail && !ain->finished ){
+        pthread_cond_wait(&ain->cond_ready,&ain->lock);
+    }
+    if(ain->head==ain->tail){
+        pthread_mutex_unlock(&ain->lock);
+        return 0;
+    }
+    const OUTBUF chunk = ain->chunk[ain->head % ASYNCIN_NCHUNK];
+    pthread_mutex_unlock(&ain->lock);
+
+    const size_t n = (chunk->len-ain->off<len) ? chunk->len-ain->off : len;
+    memcpy(buf,chunk->buf+ain->off,n);
+    ain->off += n;
+    if(ain->off==chunk->len){
+        pthread_mutex_lock(&ain->lock);
+        ain->head++;
+        ain->off = 0;
+        pthread_cond_signal(&ain->cond_free);
+        pthread_mutex_unlock(&ain->lock);
+    }
+    return n;
+}
+
+/* Input need not have been read to the end */
+void free_ASYNCIN( ASYNCIN ain){
+    validate(NULL!=ain,);
+    pthread_mutex_lock(&ain->lock);
+    ain->stop = true;
+    pthread_cond_signal(&ain->cond_free);
+    pthread_mutex_unlock(&ain->lock);
+    pthread_join(ain->thread,NULL);
+    pthread_cond_destroy(&ain->cond_free);
+    pthread_cond_destroy(&ain->cond_ready);
+    pthread_mutex_destroy(&ain->lock);
+    for ( uint32_t i=0 ; i<ASYNCIN_NCHUNK ; i++){ free_OUTBUF(ain->chunk[i]); }
+    safe_free(ain->in);
+    safe_free(ain);
+}
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _ASYNCIN_H
+#define _ASYNCIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Decompression of gzip input by a dedicated thread, the reader consuming
+ * decompressed data from a small queue of large chunks. BGZF input is split
+ * into its blocks, which are inflated in parallel by a pool of threads and
+ * queued in order; other gzip input, including concatenated members, is
+ * inflated serially.
+ */
+typedef struct _asyncin * ASYNCIN;
+
+bool is_gzip_ASYNCIN( const char * buf, const size_t len);
+ASYNCIN new_ASYNCIN( const int fd, const char * prefix, const size_t prefixlen, const uint32_t nthread);
+ssize_t read_ASYNCIN( ASYNCIN ain, char * buf, const size_t len);
+void free_ASYNCIN( ASYNCIN ain);
+
+#endif
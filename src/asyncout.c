@@ -0,0 +1,298 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <err.h>
+#include "utility.h"
+#include "pool.h"
+#include "bgzf.h"
+#include "asyncout.h"
+
+#define ASYNCOUT_NBUF 2
+
+struct _outfile {
+    int fd;
+    bool compress;
+    OUTBUF buf[ASYNCOUT_NBUF];
+    uint32_t fill;              // Buffer currently being filled by producer
+    bool pending[ASYNCOUT_NBUF]; // Submitted but not yet written
+};
+
+struct _asyncout {
+    uint32_t nfile;
+    size_t blocksize;
+    struct _outfile * file;
+    // Queue of submitted buffers, in order of submission
+    uint32_t * qfile, * qbuf;
+    uint32_t qlen, qhead, qtail;
+    bool finished;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_submit, cond_written;
+    pthread_t writer;
+    // Block compression, blocks being written in order by pool
+    POOL zpool;
+    // Statistics
+    uint64_t nblock, nbyte;
+    uint64_t nstall, nidle;
+    double stall_time, idle_time;
+};
+
+static double elapsed( const struct timespec * start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (now.tv_sec-start->tv_sec) + 1e-9*(now.tv_nsec-start->tv_nsec);
+}
+
+/* A block of output to compress and write */
+typedef struct {
+    int fd;
+    size_t len;
+    char in[BGZF_BLOCKSIZE];
+    OUTBUF out;
+} * ZJOB;
+
+static void free_ZJOB( void * arg){
+    ZJOB job = arg;
+    if(NULL==job){ return; }
+    free_OUTBUF(job->out);
+    free(job);
+}
+
+static void * new_ZJOB( void * info){
+    ZJOB job = calloc(1,sizeof(*job));
+    validate(NULL!=job,NULL);
+    job->out = new_OUTBUF(BGZF_BLOCKSIZE+1024);
+    if(NULL==job->out){ free(job); return NULL; }
+    return job;
+}
+
+static void work_ZJOB( void * arg, void * info){
+    ZJOB job = arg;
+    clear_OUTBUF(job->out);
+    if(!deflate_BGZF(job->in,job->len,job->out)){ errx(EXIT_FAILURE,"Failed to compress output"); }
+}
+
+static void write_ZJOB( void * arg, void * info){
+    ZJOB job = arg;
+    if(!write_OUTBUF(job->out,job->fd)){ err(EXIT_FAILURE,"Failed to write output"); }
+}
+
+/* Split buffer into blocks for compression. Data is copied so the buffer
+ * can be reused immediately.
+ */
+static void compress_OUTBUF( POOL zpool, const OUTBUF out, const int fd){
+    for ( size_t off=0 ; off<out->len ; off+=BGZF_BLOCKSIZE){
+        ZJOB job = next_job_POOL(zpool);
+        job->fd = fd;
+        job->len = (out->len-off<BGZF_BLOCKSIZE) ? (out->len-off) : BGZF_BLOCKSIZE;
+        memcpy(job->in,out->buf+off,job->len);
+        submit_POOL(zpool);
+    }
+    clear_OUTBUF(out);
+}
+
+static void * writer_thread( void * arg){
+    ASYNCOUT aout = arg;
+    pthread_mutex_lock(&aout->lock);
+    for(;;){
+        if(aout->qhead==aout->qtail && !aout->finished){
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC,&start);
+            aout->nidle++;
+            while(aout->qhead==aout->qtail && !aout->finished){
+                pthread_cond_wait(&aout->cond_submit,&aout->lock);
+            }
+            aout->idle_time += elapsed(&start);
+        }
+        if(aout->qhead==aout->qtail){ break; } // Finished and nothing left
+        const uint32_t f = aout->qfile[aout->qhead % aout->qlen];
+        const uint32_t b = aout->qbuf[aout->qhead % aout->qlen];
+        aout->qhead++;
+        OUTBUF out = aout->file[f].buf[b];
+        pthread_mutex_unlock(&aout->lock);
+
+        const size_t len = out->len;
+        if(aout->file[f].compress){
+            compress_OUTBUF(aout->zpool,out,aout->file[f].fd);
+        } else if(!write_OUTBUF(out,aout->file[f].fd)){
+            err(EXIT_FAILURE,"Failed to write output");
+        }
+
+        pthread_mutex_lock(&aout->lock);
+        aout->nblock++;
+        aout->nbyte += len;
+        aout->file[f].pending[b] = false;
+        pthread_cond_broadcast(&aout->cond_written);
+    }
+    pthread_mutex_unlock(&aout->lock);
+    return NULL;
+}
+
+/* Output to nfile descriptors, written in blocks of blocksize. Where compress
+ * is not NULL, files so marked are BGZF compressed using nthread threads.
+ */
+ASYNCOUT new_ASYNCOUT( const uint32_t nfile, const int * fd, const bool * compress, const size_t blocksize, const uint32_t nthread){
+    validate(nfile>0,NULL);
+    validate(NULL!=fd,NULL);
+    validate(nthread>0,NULL);
+    ASYNCOUT aout = calloc(1,sizeof(*aout));
+    validate(NULL!=aout,NULL);
+    aout->nfile = nfile;
+    aout->blocksize = blocksize;
+    aout->qlen = nfile * ASYNCOUT_NBUF;
+    aout->file = calloc(nfile,sizeof(*aout->file));
+    aout->qfile = calloc(aout->qlen,sizeof(*aout->qfile));
+    aout->qbuf = calloc(aout->qlen,sizeof(*aout->qbuf));
+    if(NULL==aout->file || NULL==aout->qfile || NULL==aout->qbuf){ goto cleanup; }
+    for ( uint32_t i=0 ; i<nfile ; i++){
+        aout->file[i].fd = fd[i];
+        aout->file[i].compress = (NULL!=compress) && compress[i];
+        if(aout->file[i].compress && NULL==aout->zpool){
+            const POOL_FUNCS funcs = { new_ZJOB, free_ZJOB, work_ZJOB, write_ZJOB };
+            aout->zpool = new_POOL(nthread,4*nthread,funcs,NULL);
+            if(NULL==aout->zpool){ goto cleanup; }
+        }
+        for ( uint32_t j=0 ; j<ASYNCOUT_NBUF ; j++){
+            // Slack so a buffer rarely needs to grow past block size
+            aout->file[i].buf[j] = new_OUTBUF(blocksize+blocksize/2);
+            if(NULL==aout->file[i].buf[j]){ goto cleanup; }
+        }
+    }
+
+    pthread_mutex_init(&aout->lock,NULL);
+    pthread_cond_init(&aout->cond_submit,NULL);
+    pthread_cond_init(&aout->cond_written,NULL);
+    if(0!=pthread_create(&aout->writer,NULL,writer_thread,aout)){
+        errx(EXIT_FAILURE,"Failed to create output thread");
+    }
+    return aout;
+
+cleanup:
+    if(NULL!=aout->zpool){ free_POOL(aout->zpool); }
+    if(NULL!=aout->file){
+        for ( uint32_t i=0 ; i<nfile ; i++){
+            for ( uint32_t j=0 ; j<ASYNCOUT_NBUF ; j++){ free_OUTBUF(aout->file[i].buf[j]); }
+        }
+    }
+    safe_free(aout->file);
+    safe_free(aout->qfile);
+    safe_free(aout->qbuf);
+    safe_free(aout);
+    return NULL;
+}
+
+/* Buffer to format output for file into. Only valid until next submission */
+OUTBUF outbuf_ASYNCOUT( const ASYNCOUT aout, const uint32_t file){
+    validate(NULL!=aout,NULL);
+    validate(file<aout->nfile,NULL);
+    return aout->file[file].buf[aout->file[file].fill];
+}
+
+/* Hand current buffer for file to output thread, waiting until the next
+ * buffer has been written if necessary.
+ */
+void submit_ASYNCOUT( ASYNCOUT aout, const uint32_t file){
+    validate(NULL!=aout,);
+    validate(file<aout->nfile,);
+    struct _outfile * f = aout->file + file;
+    if(0==f->buf[f->fill]->len){ return; }
+    const uint32_t next = (f->fill+1) % ASYNCOUT_NBUF;
+
+    pthread_mutex_lock(&aout->lock);
+    f->pending[f->fill] = true;
+    aout->qfile[aout->qtail % aout->qlen] = file;
+    aout->qbuf[aout->qtail % aout->qlen] = f->fill;
+    aout->qtail++;
+    pthread_cond_signal(&aout->cond_submit);
+    if(f->pending[next]){
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        aout->nstall++;
+        while(f->pending[next]){
+            pthread_cond_wait(&aout->cond_written,&aout->lock);
+        }
+        aout->stall_time += elapsed(&start);
+    }
+    pthread_mutex_unlock(&aout->lock);
+    f->fill = next;
+}
+
+/* Submit buffers that have reached the block size, or all if final */
+void flush_ASYNCOUT( ASYNCOUT aout, const bool final){
+    validate(NULL!=aout,);
+    for ( uint32_t i=0 ; i<aout->nfile ; i++){
+        const OUTBUF out = aout->file[i].buf[aout->file[i].fill];
+        if(out->len>=aout->blocksize || (final && out->len>0)){
+            submit_ASYNCOUT(aout,i);
+        }
+    }
+}
+
+/* Write all remaining output and stop output thread. No more output may be
+ * submitted.
+ */
+void finish_ASYNCOUT( ASYNCOUT aout){
+    validate(NULL!=aout,);
+    if(aout->finished){ return; }
+    flush_ASYNCOUT(aout,true);
+    pthread_mutex_lock(&aout->lock);
+    aout->finished = true;
+    pthread_cond_signal(&aout->cond_submit);
+    pthread_mutex_unlock(&aout->lock);
+    pthread_join(aout->writer,NULL);
+
+    if(NULL!=aout->zpool){
+        free_POOL(aout->zpool);
+        aout->zpool = NULL;
+        OUTBUF eof = aout->file[0].buf[0];
+        for ( uint32_t i=0 ; i<aout->nfile ; i++){
+            if(!aout->file[i].compress){ continue; }
+            append_eof_BGZF(eof);
+            if(!write_OUTBUF(eof,aout->file[i].fd)){ err(EXIT_FAILURE,"Failed to write output"); }
+        }
+    }
+}
+
+/* Writes any remaining output before freeing */
+void free_ASYNCOUT( ASYNCOUT aout){
+    validate(NULL!=aout,);
+    finish_ASYNCOUT(aout);
+    pthread_cond_destroy(&aout->cond_written);
+    pthread_cond_destroy(&aout->cond_submit);
+    pthread_mutex_destroy(&aout->lock);
+    for ( uint32_t i=0 ; i<aout->nfile ; i++){
+        for ( uint32_t j=0 ; j<ASYNCOUT_NBUF ; j++){ free_OUTBUF(aout->file[i].buf[j]); }
+    }
+    safe_free(aout->file);
+    safe_free(aout->qfile);
+    safe_free(aout->qbuf);
+    safe_free(aout);
+}
+
+void show_ASYNCOUT( FILE * fp, const ASYNCOUT aout){
+    validate(NULL!=fp,);
+    validate(NULL!=aout,);
+    fprintf(fp,"Output: %llu blocks, %.1f MB written\n",(unsigned long long)aout->nblock,aout->nbyte/1048576.0);
+    fprintf(fp,"Simulation waited for output %llu times (%.3fs)\n",(unsigned long long)aout->nstall,aout->stall_time);
+    fprintf(fp,"Output thread waited for simulation %llu times (%.3fs)\n",(unsigned long long)aout->nidle,aout->idle_time);
+}
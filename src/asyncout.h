@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _ASYNCOUT_H
+#define _ASYNCOUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "outbuf.h"
+
+/* Double-buffered output to a set of files, written by a dedicated thread.
+ * A single producer formats into the current buffer of a file and submits it
+ * once full; the buffer is then written by the output thread while the
+ * producer continues with the other buffer for that file. The producer only
+ * waits if it fills a buffer before the previous one for the same file has
+ * been written.
+ * Counts of waits on each side show whether a run is limited by output
+ * (producer waits) or by simulation (output thread idle).
+ * Files may be BGZF compressed, blocks being compressed by a pool of
+ * threads and written in order.
+ */
+typedef struct _asyncout * ASYNCOUT;
+
+ASYNCOUT new_ASYNCOUT( const uint32_t nfile, const int * fd, const bool * compress, const size_t blocksize, const uint32_t nthread);
+OUTBUF outbuf_ASYNCOUT( const ASYNCOUT aout, const uint32_t file);
+void submit_ASYNCOUT( ASYNCOUT aout, const uint32_t file);
+void flush_ASYNCOUT( ASYNCOUT aout, const bool final);
+void finish_ASYNCOUT( ASYNCOUT aout);
+void free_ASYNCOUT( ASYNCOUT aout);
+void show_ASYNCOUT( FILE * fp, const ASYNCOUT aout);
+
+#endif
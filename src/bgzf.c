@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <zlib.h>
+#include "utility.h"
+#include "bgzf.h"
+
+static const char bgzf_header[BGZF_HEADER] = {
+    0x1f, (char)0x8b, 8, 4,   // gzip magic, deflate, FEXTRA
+    0, 0, 0, 0,         // mtime
+    0, (char)0xff,      // xfl, OS unknown
+    6, 0,               // Length of extra field
+    'B', 'C', 2, 0,     // BGZF subfield, length 2
+    0, 0                // Block size - 1, filled in
+};
+
+static void put_le16( char * p, const uint32_t x){
+    p[0] = x & 0xff;
+    p[1] = (x>>8) & 0xff;
+}
+
+static void put_le32( char * p, const uint32_t x){
+    put_le16(p,x);
+    put_le16(p+2,x>>16);
+}
+
+/* Raw deflate of in into dst, returning compressed length or zero if it
+ * doesn't fit.
+ */
+static size_t deflate_raw( const char * in, const size_t len, char * dst, const size_t dstlen, const int level){
+    z_stream zs = {0};
+    if(Z_OK!=deflateInit2(&zs,level,Z_DEFLATED,-15,8,Z_DEFAULT_STRATEGY)){ return 0; }
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = len;
+    zs.next_out = (Bytef *)dst;
+    zs.avail_out = dstlen;
+    const int ret = deflate(&zs,Z_FINISH);
+    const size_t clen = zs.total_out;
+    deflateEnd(&zs);
+    return (Z_STREAM_END==ret) ? clen : 0;
+}
+
+/* Compress upto BGZF_BLOCKSIZE bytes as a single block appended to out */
+bool deflate_BGZF( const char * in, const size_t len, OUTBUF out){
+    validate(NULL!=in || 0==len,false);
+    validate(len<=BGZF_BLOCKSIZE,false);
+    validate(NULL!=out,false);
+    char * blk = reserve_OUTBUF(out,BGZF_MAXBLOCK);
+    const size_t maxc = BGZF_MAXBLOCK - BGZF_HEADER - BGZF_FOOTER;
+
+    size_t clen = deflate_raw(in,len,blk+BGZF_HEADER,maxc,Z_DEFAULT_COMPRESSION);
+    if(0==clen){
+        // Incompressible input may expand past the maximum block size; stored
+        // blocks always fit.
+        clen = deflate_raw(in,len,blk+BGZF_HEADER,maxc,Z_NO_COMPRESSION);
+        if(0==clen){ return false; }
+    }
+
+    const size_t blen = BGZF_HEADER + clen + BGZF_FOOTER;
+    memcpy(blk,bgzf_header,BGZF_HEADER);
+    put_le16(blk+16,blen-1);
+    put_le32(blk+BGZF_HEADER+clen,crc32(crc32(0L,Z_NULL,0),(const Bytef *)in,len));
+    put_le32(blk+BGZF_HEADER+clen+4,len);
+    out->len += blen;
+    return true;
+}
+
+/* Empty block marking the end of a BGZF file */
+void append_eof_BGZF( OUTBUF out){
+    static const char eof[28] = {
+        0x1f, (char)0x8b, 8, 4, 0, 0, 0, 0, 0, (char)0xff, 6, 0, 'B', 'C', 2, 0,
+        0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    append_OUTBUF(out,eof,sizeof(eof));
+}
+
+static uint32_t get_le16( const char * p){
+    return (uint8_t)p[0] | ((uint32_t)(uint8_t)p[1]<<8);
+}
+
+static uint32_t get_le32( const char * p){
+    return get_le16(p) | (get_le16(p+2)<<16);
+}
+
+/* Total size of the block whose first BGZF_HEADER bytes are hdr, or zero if
+ * hdr is not the header of a BGZF block.
+ */
+size_t blocksize_BGZF( const char * hdr){
+    validate(NULL!=hdr,0);
+    if( 0x1f!=(uint8_t)hdr[0] || 0x8b!=(uint8_t)hdr[1] || 8!=hdr[2] || 0==(hdr[3]&4) ){ return 0; }
+    if( 6!=get_le16(hdr+10) || 'B'!=hdr[12] || 'C'!=hdr[13] || 2!=get_le16(hdr+14) ){ return 0; }
+    const size_t blen = get_le16(hdr+16) + 1;
+    return (blen>=BGZF_HEADER+BGZF_FOOTER) ? blen : 0;
+}
+
+/* Decompress a complete block of blen bytes into out, which must have room
+ * for BGZF_MAXBLOCK bytes. Returns false if the block is corrupt.
+ */
+bool inflate_BGZF( const char * blk, const size_t blen, char * out, size_t * len){
+    validate(NULL!=blk,false);
+    validate(NULL!=out,false);
+    validate(NULL!=len,false);
+    if(blen<BGZF_HEADER+BGZF_FOOTER){ return false; }
+    z_stream zs = {0};
+    if(Z_OK!=inflateInit2(&zs,-15)){ return false; }
+    zs.next_in = (Bytef *)(blk+BGZF_HEADER);
+    zs.avail_in = blen - BGZF_HEADER - BGZF_FOOTER;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = BGZF_MAXBLOCK;
+    const int ret = inflate(&zs,Z_FINISH);
+    *len = zs.total_out;
+    inflateEnd(&zs);
+    if(Z_STREAM_END!=ret){ return false; }
+    const char * footer = blk + blen - BGZF_FOOTER;
+    return get_le32(footer)==crc32(crc32(0L,Z_NULL,0),(const Bytef *)out,*len)
+        && get_le32(footer+4)==*len;
+}
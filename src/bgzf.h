@@ -0,0 +1,45 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _BGZF_H
+#define _BGZF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "outbuf.h"
+
+/* Blocked gzip (BGZF), as used by samtools and tabix: a series of gzip
+ * members each holding at most BGZF_BLOCKSIZE bytes of input, with the
+ * compressed size recorded in an extra field so blocks can be located
+ * without decompression. The file ends with an empty block. Any gzip
+ * reader can decompress the result.
+ */
+#define BGZF_BLOCKSIZE 0xff00
+#define BGZF_HEADER 18
+#define BGZF_FOOTER 8
+#define BGZF_MAXBLOCK 0x10000
+
+bool deflate_BGZF( const char * in, const size_t len, OUTBUF out);
+void append_eof_BGZF( OUTBUF out);
+size_t blocksize_BGZF( const char * hdr);
+bool inflate_BGZF( const char * blk, const size_t blen, char * out, size_t * len);
+
+#endif
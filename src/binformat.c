@@ -0,0 +1,301 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include "utility.h"
+#include "nuc.h"
+#include "binformat.h"
+
+#define LIKE_CALLOFFSET (3*sizeof(uint32_t))
+
+static inline uint32_t pad4( const uint32_t n){
+    return (n+3) & ~3U;
+}
+
+static uint32_t recsize_BINFORMAT( const BINHEADER * header){
+    const uint32_t n = header->nend * header->ncycle;
+    switch(header->type){
+        case BINFORMAT_INTENSITIES: return 2*sizeof(uint32_t) + n*NBASE*sizeof(float);
+        case BINFORMAT_LIKELIHOODS:
+            if(8!=header->bits && 16!=header->bits){ return 0; }
+            return LIKE_CALLOFFSET + pad4(n) + n*(NBASE-1)*(header->bits/8);
+    }
+    return 0;
+}
+
+/* Offset of differences within a likelihood record */
+uint32_t diffoffset_BINFORMAT( const BINHEADER * header){
+    validate(NULL!=header,0);
+    return LIKE_CALLOFFSET + pad4(header->nend * header->ncycle);
+}
+
+BINHEADER new_BINHEADER( const enum binformat_type type, const uint32_t ncycle, const uint32_t nend, const uint32_t lane, const uint32_t tile){
+    BINHEADER header = {
+        .magic = BINFORMAT_MAGIC,
+        .byteorder = BINFORMAT_BYTEORDER,
+        .version = BINFORMAT_VERSION,
+        .type = type,
+        .ncycle = ncycle, .nend = nend, .lane = lane, .tile = tile
+    };
+    header.recsize = recsize_BINFORMAT(&header);
+    return header;
+}
+
+BINHEADER new_likelihood_BINHEADER( const uint32_t ncycle, const uint32_t nend, const uint32_t lane, const uint32_t tile, const uint32_t bits, const float step){
+    BINHEADER header = new_BINHEADER(BINFORMAT_LIKELIHOODS,ncycle,nend,lane,tile);
+    header.bits = bits;
+    header.step = step;
+    header.recsize = recsize_BINFORMAT(&header);
+    return header;
+}
+
+/* Read and check header. Returns false if file is not in a format understood */
+bool read_BINHEADER( FILE * fp, BINHEADER * header){
+    validate(NULL!=fp,false);
+    validate(NULL!=header,false);
+    if(1!=fread(header,sizeof(*header),1,fp)){ return false; }
+    if(0!=memcmp(header->magic,BINFORMAT_MAGIC,sizeof(BINFORMAT_MAGIC))){ return false; }
+    if(BINFORMAT_BYTEORDER!=header->byteorder){ return false; }
+    if(BINFORMAT_VERSION!=header->version){ return false; }
+    if(0==header->recsize || header->recsize!=recsize_BINFORMAT(header)){ return false; }
+    return true;
+}
+
+void append_BINHEADER( OUTBUF out, const BINHEADER * header){
+    append_OUTBUF(out,(const char *)header,sizeof(*header));
+}
+
+static void append_floats( OUTBUF out, const MAT mat){
+    const uint32_t n = mat->nrow * mat->ncol;
+    char * ptr = reserve_OUTBUF(out,n*sizeof(float));
+    for ( uint32_t i=0 ; i<n ; i++){
+        const float fi = mat->x[i];
+        memcpy(ptr+i*sizeof(float),&fi,sizeof(float));
+    }
+    out->len += n*sizeof(float);
+}
+
+/* Intensity record. ints2 may be NULL for single-ended reads */
+void append_intensities_BINFORMAT( OUTBUF out, const uint32_t x, const uint32_t y, const MAT ints1, const MAT ints2){
+    validate(NULL!=out,);
+    validate(NULL!=ints1,);
+    const uint32_t loc[2] = {x,y};
+    append_OUTBUF(out,(const char *)loc,sizeof(loc));
+    append_floats(out,ints1);
+    if(NULL!=ints2){ append_floats(out,ints2); }
+}
+
+/* Quantised likelihood record. like2 may be NULL for single-ended reads or
+ * when each end is written as a record of its own, numbered by end.
+ * Records are filled in place, calls and differences being written in one
+ * pass over each cycle.
+ */
+void append_likelihoods_BINFORMAT( OUTBUF out, const uint32_t bits, const float step, const uint32_t x, const uint32_t y, const bool pass_filter, const uint32_t end, const MAT like1, const MAT like2){
+    validate(NULL!=out,);
+    validate(NULL!=like1,);
+    validate(end<=UINT8_MAX,);
+    validate(8==bits || 16==bits,);
+    validate(step>0.,);
+    const MAT like[2] = {like1,like2};
+    const uint32_t nend = (NULL!=like2)?2:1;
+    const uint32_t ncycle = like1->ncol;
+    const BINHEADER header = new_likelihood_BINHEADER(ncycle,nend,0,0,bits,step);
+
+    char * rec = reserve_OUTBUF(out,header.recsize);
+    memset(rec,0,header.recsize);
+    const uint32_t loc[2] = {x,y};
+    memcpy(rec,loc,sizeof(loc));
+    rec[sizeof(loc)+1] = end;
+    out->len += header.recsize;
+    if(!pass_filter){ return; }
+    rec[sizeof(loc)] = 1;
+
+    uint8_t * call = (uint8_t *)(rec + LIKE_CALLOFFSET);
+    char * diff = rec + diffoffset_BINFORMAT(&header);
+    const real_t scale = 1.0/step;
+    const real_t qmax = (8==bits)?UINT8_MAX:UINT16_MAX;
+    for ( uint32_t e=0 ; e<nend ; e++){
+        for ( uint32_t cycle=0 ; cycle<ncycle ; cycle++){
+            const real_t * l = like[e]->x + cycle*NBASE;
+            uint32_t c = 0;
+            for ( uint32_t b=1 ; b<NBASE ; b++){
+                if(l[b]<l[c]){ c = b; }
+            }
+            *call++ = c;
+            for ( uint32_t b=0 ; b<NBASE ; b++){
+                if(b==c){ continue; }
+                real_t q = (l[b]-l[c])*scale + 0.5;
+                if(!(q<qmax)){ q = qmax; }  // Also catches NaN and infinity
+                if(8==bits){
+                    *(uint8_t *)diff = (uint8_t)q;
+                    diff += sizeof(uint8_t);
+                } else {
+                    const uint16_t q16 = (uint16_t)q;
+                    memcpy(diff,&q16,sizeof(q16));
+                    diff += sizeof(uint16_t);
+                }
+            }
+        }
+    }
+}
+
+/* Same layout as text written by simNGS: location, then values for each
+ * cycle separated by tabs.
+ */
+static void append_location( OUTBUF out, const BINHEADER * header, const uint32_t * loc){
+    append_uint_OUTBUF(out,header->lane); append_char_OUTBUF(out,'\t');
+    append_uint_OUTBUF(out,header->tile); append_char_OUTBUF(out,'\t');
+    append_uint_OUTBUF(out,loc[0]); append_char_OUTBUF(out,'\t');
+    append_uint_OUTBUF(out,loc[1]);
+}
+
+static void append_intensity_text( OUTBUF out, const BINHEADER * header, const char * rec){
+    uint32_t loc[2];
+    memcpy(loc,rec,sizeof(loc));
+    append_location(out,header,loc);
+    const char * ptr = rec + sizeof(loc);
+    const uint32_t n = header->nend * header->ncycle * NBASE;
+    for ( uint32_t i=0 ; i<n ; i++){
+        float f;
+        memcpy(&f,ptr+i*sizeof(float),sizeof(float));
+        append_char_OUTBUF(out,(i%NBASE)?' ':'\t');
+        append_real_OUTBUF(out,f);
+    }
+    append_char_OUTBUF(out,'\n');
+}
+
+/* Likelihoods normalised so that of the call is zero. Filtered reads have
+ * location only, as simNGS writes them. Each record is one line, whether it
+ * holds every end of the read or just one.
+ */
+static void append_likelihood_text( OUTBUF out, const BINHEADER * header, const char * rec){
+    uint32_t loc[2];
+    memcpy(loc,rec,sizeof(loc));
+    append_location(out,header,loc);
+    if(rec[sizeof(loc)]){
+        const uint8_t * call = (const uint8_t *)(rec + LIKE_CALLOFFSET);
+        const char * diff = rec + diffoffset_BINFORMAT(header);
+        const uint32_t n = header->nend * header->ncycle;
+        for ( uint32_t i=0 ; i<n ; i++){
+            for ( uint32_t b=0 ; b<NBASE ; b++){
+                real_t l = 0.;
+                if(b!=call[i]){
+                    if(8==header->bits){
+                        l = *(const uint8_t *)diff;
+                        diff += sizeof(uint8_t);
+                    } else {
+                        uint16_t q16;
+                        memcpy(&q16,diff,sizeof(q16));
+                        l = q16;
+                        diff += sizeof(uint16_t);
+                    }
+                    l *= header->step;
+                }
+                append_char_OUTBUF(out,b?' ':'\t');
+                append_real_OUTBUF(out,l);
+            }
+        }
+    }
+    append_char_OUTBUF(out,'\n');
+}
+
+/* Text that simNGS would have written for a record */
+void append_text_BINFORMAT( OUTBUF out, const BINHEADER * header, const char * rec){
+    validate(NULL!=out,);
+    validate(NULL!=header,);
+    validate(NULL!=rec,);
+    switch(header->type){
+        case BINFORMAT_INTENSITIES: append_intensity_text(out,header,rec); break;
+        case BINFORMAT_LIKELIHOODS: append_likelihood_text(out,header,rec); break;
+        default: errx(EXIT_FAILURE,"Unrecognised type of binary file in %s (%s:%d)",__func__,__FILE__,__LINE__);
+    }
+}
+
+#ifdef TEST
+/* Round trip of paired-end likelihoods written to a single stream: each end
+ * is a record of its own and converts back to the two lines simNGS writes as
+ * text. Values are multiples of the step so quantisation is exact.
+ */
+static void append_expected( OUTBUF out, const BINHEADER * header, const uint32_t * loc, const MAT like, const bool pass_filter){
+    append_location(out,header,loc);
+    if(pass_filter){
+        for ( uint32_t cycle=0 ; cycle<like->ncol ; cycle++){
+            const real_t * l = like->x + cycle*NBASE;
+            real_t lmin = l[0];
+            for ( uint32_t b=1 ; b<NBASE ; b++){ if(l[b]<lmin){ lmin = l[b]; } }
+            for ( uint32_t b=0 ; b<NBASE ; b++){
+                append_char_OUTBUF(out,b?' ':'\t');
+                append_real_OUTBUF(out,l[b]-lmin);
+            }
+        }
+    }
+    append_char_OUTBUF(out,'\n');
+}
+
+int main(int argc, char * argv[]){
+    const uint32_t ncycle = 7, nread = 5;
+    const float step = 0.25;
+    bool success = true;
+    MAT like[2] = {new_MAT(NBASE,ncycle),new_MAT(NBASE,ncycle)};
+    OUTBUF bin = new_OUTBUF(1024), text = new_OUTBUF(1024), expected = new_OUTBUF(1024);
+    const uint32_t bits[2] = {8,16};
+    for ( uint32_t k=0 ; k<2 ; k++){
+        clear_OUTBUF(bin); clear_OUTBUF(text); clear_OUTBUF(expected);
+        const BINHEADER header = new_likelihood_BINHEADER(ncycle,1,3,17,bits[k],step);
+        for ( uint32_t r=0 ; r<nread ; r++){
+            const uint32_t loc[2] = {100+r,2000-r};
+            const bool pass_filter = (r!=2);
+            for ( uint32_t end=0 ; end<2 ; end++){
+                for ( uint32_t i=0 ; i<NBASE*ncycle ; i++){
+                    like[end]->x[i] = 10.0 + step*((7*i+3*r+5*end)%23);
+                }
+                append_likelihoods_BINFORMAT(bin,bits[k],step,loc[0],loc[1],pass_filter,end,like[end],NULL);
+                append_expected(expected,&header,loc,like[end],pass_filter);
+            }
+        }
+        if(bin->len!=2*nread*header.recsize){
+            fprintf(stdout,"%u bits: wrote %zu bytes, expected %u\n",bits[k],bin->len,2*nread*header.recsize);
+            success = false;
+            continue;
+        }
+        for ( uint32_t i=0 ; i<2*nread ; i++){
+            const char * rec = bin->buf + i*header.recsize;
+            if(rec[2*sizeof(uint32_t)+1]!=(char)(i%2)){
+                fprintf(stdout,"%u bits: record %u has end %d\n",bits[k],i,rec[2*sizeof(uint32_t)+1]);
+                success = false;
+            }
+            append_text_BINFORMAT(text,&header,rec);
+        }
+        const bool same = (text->len==expected->len && 0==memcmp(text->buf,expected->buf,text->len));
+        fprintf(stdout,"%u bits: round trip %s\n",bits[k],same?"identical":"differs");
+        if(!same){
+            fwrite(expected->buf,1,expected->len,stdout);
+            fwrite(text->buf,1,text->len,stdout);
+            success = false;
+        }
+    }
+    free_OUTBUF(expected); free_OUTBUF(text); free_OUTBUF(bin);
+    free_MAT(like[1]); free_MAT(like[0]);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
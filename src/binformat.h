@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _BINFORMAT_H
+#define _BINFORMAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "outbuf.h"
+
+/* Binary output of simNGS.
+ * A file starts with a header, in host byte order, followed by fixed size
+ * records, one per read, so a file may be memory-mapped and read i
+ * located at offset sizeof(BINHEADER) + i * recsize.
+ *
+ * Intensity records (BINFORMAT_INTENSITIES):
+ *   uint32_t x, y       Location of cluster on tile
+ *   float ints[nend][ncycle][NBASE]
+ *
+ * Likelihood records (BINFORMAT_LIKELIHOODS), quantised with "bits" (8 or
+ * 16) bits per value and resolution "step" given in the header:
+ *   uint32_t x, y       Location of cluster on tile
+ *   uint8_t pass_filter, end, padding[2]
+ *   uint8_t call[nend][ncycle]         Padded to a multiple of four bytes
+ *   uintN_t diff[nend][ncycle][NBASE-1]
+ * The call is the base with maximum likelihood and diff the quantised
+ * difference of -log-likelihood between each other base, in order ACGT, and
+ * the call: -log-likelihood(b) - -log-likelihood(call) ~= diff * step.
+ * Differences too large to be represented are stored as the maximum value.
+ * Records for reads that fail the purity filter are zero other than x, y and
+ * end. A record holds either every end of the read (nend in the header) or,
+ * when ends are written as separate lines, one end given by "end" counting
+ * from zero; both ends of a paired read going to the same file are then
+ * consecutive records, in the same order as the text lines.
+ * A reader reconstructs the -log-likelihoods normalised so that of the call
+ * is zero, which gives the same calls and qualities as unnormalised values.
+ */
+#define BINFORMAT_MAGIC "simNGSb"
+#define BINFORMAT_BYTEORDER 0x01020304
+#define BINFORMAT_VERSION 1
+
+enum binformat_type { BINFORMAT_INTENSITIES=0, BINFORMAT_LIKELIHOODS };
+
+typedef struct {
+    char magic[8];
+    uint32_t byteorder, version, type;
+    uint32_t ncycle, nend, lane, tile;
+    uint32_t recsize;
+    uint32_t bits;          // Likelihoods only, zero otherwise
+    float step;
+    uint32_t reserved;
+} BINHEADER;
+
+BINHEADER new_BINHEADER( const enum binformat_type type, const uint32_t ncycle, const uint32_t nend, const uint32_t lane, const uint32_t tile);
+BINHEADER new_likelihood_BINHEADER( const uint32_t ncycle, const uint32_t nend, const uint32_t lane, const uint32_t tile, const uint32_t bits, const float step);
+bool read_BINHEADER( FILE * fp, BINHEADER * header);
+uint32_t diffoffset_BINFORMAT( const BINHEADER * header);
+void append_BINHEADER( OUTBUF out, const BINHEADER * header);
+
+void append_intensities_BINFORMAT( OUTBUF out, const uint32_t x, const uint32_t y, const MAT ints1, const MAT ints2);
+void append_likelihoods_BINFORMAT( OUTBUF out, const uint32_t bits, const float step, const uint32_t x, const uint32_t y, const bool pass_filter, const uint32_t end, const MAT like1, const MAT like2);
+
+void append_text_BINFORMAT( OUTBUF out, const BINHEADER * header, const char * rec);
+
+#endif
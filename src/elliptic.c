@@ -38,7 +38,8 @@ real_t lognormal_radius( int n ){
 	return sqrt( rlognorm(log(n)-0.5*lognormal_sd*lognormal_sd,lognormal_sd) );
 }
 
-MAT relliptic_cycle ( const MAT mean, const MAT * L, real_t (*randomradius)(int), const uint32_t n, MAT z){
+/* L holds packed lower triangular factors for each cycle, see TRI_INDEX */
+MAT relliptic_cycle ( const MAT mean, const real_t * L, real_t (*randomradius)(int), const uint32_t n, MAT z){
     if ( NULL==z){
         z = new_MAT(n,1);
         validate(NULL!=z,NULL);
@@ -59,10 +60,11 @@ MAT relliptic_cycle ( const MAT mean, const MAT * L, real_t (*randomradius)(int)
         }
 
         if(NULL!=L){
+            const real_t * Lcy = L + cy*TRI_SIZE(NBASE);
             for ( int i=3 ; i>=0 ; i--){
-                z->x[offset+i] *= L[cy]->x[i*NBASE+i];
+                z->x[offset+i] *= Lcy[TRI_INDEX(i,i)];
                 for ( int j=0 ; j<i ; j++){
-                    z->x[offset+i] += z->x[offset+j] * L[cy]->x[i*NBASE+j];
+                    z->x[offset+i] += z->x[offset+j] * Lcy[TRI_INDEX(i,j)];
                 }
             }
         }
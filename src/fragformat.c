@@ -0,0 +1,265 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "utility.h"
+#include "fragformat.h"
+
+static const char cigar_ops[] = "MIDNSHP=X";
+
+void append_fragname(OUTBUF out, const char * name, const unsigned int idx, const char strand, const uint32_t loc, const uint32_t fraglen, CSTRING fmt){
+    if(!strcmp(fmt, "casava")){
+        // CASAVA 1.8 format:
+        //
+        // @EAS139:136:FC706VJ:2:5:1000:12850  1:Y:18:ATCACG
+        // 
+        // Information like tiles coordinates is made up by loc & fraglen,
+        // so it does not make much sense semantically. The intention is that programs
+        // expecting a certain header structure do not bail out unnecesarily.
+        append_cstring_OUTBUF(out,"SIMNGS:");
+        append_uint_OUTBUF(out,idx);
+        append_cstring_OUTBUF(out,":fcsimNGS:1:1:1:1 1:N:2:GATTACA");
+    } else if (!strcmp(fmt, "fasta")){
+        // Old custom format by original SIMNGS's simlibrary
+        append_cstring_OUTBUF(out,"Frag_");
+        append_uint_OUTBUF(out,idx);
+        append_char_OUTBUF(out,' ');
+        append_cstring_OUTBUF(out,name);
+        append_cstring_OUTBUF(out," (Strand ");
+        append_char_OUTBUF(out,strand);
+        append_cstring_OUTBUF(out," Offset ");
+        append_uint_OUTBUF(out,loc+1);
+        append_cstring_OUTBUF(out,"--");
+        append_uint_OUTBUF(out,loc+fraglen);
+        append_char_OUTBUF(out,')');
+    }
+}
+
+FRAGHEADER new_FRAGHEADER( const CSTRING namefmt){
+    FRAGHEADER header = {
+        .magic = FRAGFORMAT_MAGIC,
+        .byteorder = FRAGFORMAT_BYTEORDER,
+        .version = FRAGFORMAT_VERSION,
+        .namefmt = (NULL!=namefmt && !strcmp(namefmt,"casava")) ? FRAGNAME_CASAVA : FRAGNAME_FASTA
+    };
+    return header;
+}
+
+/* Whether buf, the start of some input, is a fragment stream */
+bool is_FRAGFORMAT( const char * buf, const size_t len){
+    return len>=sizeof(FRAGFORMAT_MAGIC) && 0==memcmp(buf,FRAGFORMAT_MAGIC,sizeof(FRAGFORMAT_MAGIC));
+}
+
+/* Whether stream with header can be read by this build. Warns if not */
+bool check_FRAGHEADER( const FRAGHEADER * header){
+    validate(NULL!=header,false);
+    if(0!=memcmp(header->magic,FRAGFORMAT_MAGIC,sizeof(FRAGFORMAT_MAGIC))
+       || FRAGFORMAT_BYTEORDER!=header->byteorder || FRAGFORMAT_VERSION!=header->version
+       || header->namefmt>FRAGNAME_CASAVA ){
+        warnx("Fragment stream is of an unsupported version or byte order");
+        return false;
+    }
+    return true;
+}
+
+void append_FRAGHEADER( OUTBUF out, const FRAGHEADER * header){
+    validate(NULL!=out,);
+    validate(NULL!=header,);
+    append_OUTBUF(out,(const char *)header,sizeof(*header));
+}
+
+static inline uint32_t pad4( const uint32_t len){
+    return (len+3) & ~(uint32_t)3;
+}
+
+static inline char * put_uint32( char * ptr, const uint32_t u){
+    memcpy(ptr,&u,sizeof(u));
+    return ptr + sizeof(u);
+}
+
+static inline uint32_t get_uint32( const char * ptr){
+    uint32_t u;
+    memcpy(&u,ptr,sizeof(u));
+    return u;
+}
+
+void append_source_FRAGFORMAT( OUTBUF out, const char * name){
+    validate(NULL!=out,);
+    validate(NULL!=name,);
+    const uint32_t len = strlen(name);
+    const uint32_t reclen = pad4(len+1);
+    char * ptr = reserve_OUTBUF(out,2*sizeof(uint32_t)+reclen);
+    ptr = put_uint32(ptr,FRAGFORMAT_SOURCE);
+    ptr = put_uint32(ptr,reclen);
+    memcpy(ptr,name,len);
+    memset(ptr+len,0,reclen-len);
+    out->len += 2*sizeof(uint32_t) + reclen;
+}
+
+/* Fragment of length bases, with cigar describing its mutation from the
+ * source, both in the orientation of the fragment.
+ */
+void append_fragment_FRAGFORMAT( OUTBUF out, const uint32_t idx, const uint32_t loc, const uint32_t srclen, const char strand, const NUC * nucs, const uint32_t length, const CIGLIST * cigar){
+    validate(NULL!=out,);
+    validate(NULL!=nucs || 0==length,);
+    validate(NULL!=cigar,);
+    uint32_t nrun = 0;
+    bool inrun = false;
+    for ( uint32_t i=0 ; i<length ; i++){
+        const bool ambig = (NUC_AMBIG==nucs[i]);
+        nrun += ambig && !inrun;
+        inrun = ambig;
+    }
+    const uint32_t npacked = (length+3)/4;
+    const uint32_t reclen = pad4(7*sizeof(uint32_t) + (cigar->nop+2*nrun)*sizeof(uint32_t) + npacked);
+    char * ptr = reserve_OUTBUF(out,2*sizeof(uint32_t)+reclen);
+    char * end = ptr + 2*sizeof(uint32_t) + reclen;
+    ptr = put_uint32(ptr,FRAGFORMAT_FRAGMENT);
+    ptr = put_uint32(ptr,reclen);
+    ptr = put_uint32(ptr,idx);
+    ptr = put_uint32(ptr,loc);
+    ptr = put_uint32(ptr,srclen);
+    ptr = put_uint32(ptr,length);
+    ptr = put_uint32(ptr,cigar->nop);
+    ptr = put_uint32(ptr,nrun);
+    ptr = put_uint32(ptr,(uint8_t)strand);
+    for ( uint32_t i=0 ; i<cigar->nop ; i++){
+        const CIGOP op = get_CIGLIST(cigar,i);
+        const char * code = strchr(cigar_ops,op.type);
+        ptr = put_uint32(ptr,(op.num<<4) | ((NULL!=code && '\0'!=op.type)?(code-cigar_ops):0));
+    }
+    for ( uint32_t i=0, r=0 ; r<nrun ; i++){
+        if(NUC_AMBIG!=nucs[i]){ continue; }
+        uint32_t j = i+1;
+        while(j<length && NUC_AMBIG==nucs[j]){ j++; }
+        ptr = put_uint32(ptr,i);
+        ptr = put_uint32(ptr,j-i);
+        i = j; r++;
+    }
+    // Bases packed four at a time, ambiguous bases becoming A
+    uint8_t * packed = (uint8_t *)ptr;
+    const uint32_t nfull = length/4;
+    for ( uint32_t k=0 ; k<nfull ; k++){
+        const NUC * n = nucs + 4*k;
+        packed[k] = (n[0]&3) | (n[1]&3)<<2 | (n[2]&3)<<4 | (n[3]&3)<<6;
+    }
+    memset(packed+nfull,0,end-(char *)(packed+nfull));
+    for ( uint32_t i=4*nfull ; i<length ; i++){
+        packed[nfull] |= (nucs[i]&3) << (2*(i&3));
+    }
+    out->len += 2*sizeof(uint32_t) + reclen;
+}
+
+/* Fields of the reclen bytes of a fragment record. Returns false if the
+ * record is corrupt.
+ */
+bool view_FRAGFORMAT( const char * rec, const uint32_t reclen, FRAGVIEW * view){
+    validate(NULL!=rec,false);
+    validate(NULL!=view,false);
+    if(reclen<7*sizeof(uint32_t)){ return false; }
+    view->idx = get_uint32(rec); view->loc = get_uint32(rec+4); view->srclen = get_uint32(rec+8);
+    view->length = get_uint32(rec+12); view->nop = get_uint32(rec+16); view->nrun = get_uint32(rec+20);
+    view->strand = rec[24];
+    const uint64_t need = 7*sizeof(uint32_t) + ((uint64_t)view->nop+2*(uint64_t)view->nrun)*sizeof(uint32_t) + ((uint64_t)view->length+3)/4;
+    if(need>reclen){ return false; }
+    view->cigar = rec + 7*sizeof(uint32_t);
+    view->run = view->cigar + view->nop*sizeof(uint32_t);
+    view->bases = (const uint8_t *)(view->run + 2*view->nrun*sizeof(uint32_t));
+    return true;
+}
+
+/* Name of fragment from the source sequence, as simLibrary would write it.
+ * Ends with a space, as read from fasta, and is nul terminated.
+ */
+void append_name_FRAGVIEW( OUTBUF out, const FRAGHEADER * header, const char * source, const FRAGVIEW * view){
+    validate(NULL!=out,);
+    validate(NULL!=header,);
+    validate(NULL!=view,);
+    append_fragname(out,(NULL!=source)?source:"",view->idx,view->strand,view->loc,view->srclen,(FRAGNAME_CASAVA==header->namefmt)?"casava":"fasta");
+    append_OUTBUF(out," ",2);
+}
+
+/* Unpack bases into nucs, which has room for view->length. Returns false if
+ * the runs of ambiguous bases are corrupt.
+ */
+bool nucs_from_FRAGVIEW( const FRAGVIEW * view, NUC * nucs){
+    validate(NULL!=view,false);
+    validate(NULL!=nucs,false);
+    const uint32_t length = view->length;
+    const uint8_t * packed = view->bases;
+    const uint32_t nfull = length/4;
+    for ( uint32_t k=0 ; k<nfull ; k++){
+        const uint8_t p = packed[k];
+        NUC * n = nucs + 4*k;
+        n[0] = p&3; n[1] = (p>>2)&3; n[2] = (p>>4)&3; n[3] = p>>6;
+    }
+    for ( uint32_t i=4*nfull ; i<length ; i++){
+        nucs[i] = (packed[i>>2] >> (2*(i&3))) & 3;
+    }
+    for ( uint32_t r=0 ; r<view->nrun ; r++){
+        const uint32_t start = get_uint32(view->run+8*r), len = get_uint32(view->run+8*r+4);
+        if(start>length || len>length-start){ return false; }
+        for ( uint32_t i=start ; i<start+len ; i++){ nucs[i] = NUC_AMBIG; }
+    }
+    return true;
+}
+
+/* Append operations of fragment's cigar to cigar, whose storage is reused if
+ * it has room. Returns false if an operation is not recognised.
+ */
+bool cigar_from_FRAGVIEW( const FRAGVIEW * view, CIGLIST * cigar){
+    validate(NULL!=view,false);
+    validate(NULL!=cigar,false);
+    for ( uint32_t i=0 ; i<view->nop ; i++){
+        const uint32_t op = get_uint32(view->cigar+i*sizeof(uint32_t));
+        if((op&15)>=sizeof(cigar_ops)-1){ return false; }
+        *cigar = pushEnd_CIGLIST(*cigar,cigar_ops[op&15],op>>4);
+    }
+    return true;
+}
+
+/* Fragment from the reclen bytes of a fragment record, named from the
+ * source sequence as simLibrary would. Returns NULL if the record is
+ * corrupt.
+ */
+SEQ sequence_from_FRAGFORMAT( const FRAGHEADER * header, const char * source, const char * rec, const uint32_t reclen, OUTBUF scratch){
+    validate(NULL!=header,NULL);
+    validate(NULL!=rec,NULL);
+    validate(NULL!=scratch,NULL);
+    FRAGVIEW view;
+    if(!view_FRAGFORMAT(rec,reclen,&view)){ return NULL; }
+
+    SEQ seq = new_SEQ((view.length>0)?view.length:1,false);
+    validate(NULL!=seq,NULL);
+    seq->length = seq->seq.nelt = view.length;
+    clear_OUTBUF(scratch);
+    append_name_FRAGVIEW(scratch,header,source,&view);
+    seq->name = copy_CSTRING(scratch->buf);
+    if(NULL==seq->name){ goto cleanup; }
+    if(!cigar_from_FRAGVIEW(&view,&seq->cigar)){ goto cleanup; }
+    if(!nucs_from_FRAGVIEW(&view,seq->seq.elt)){ goto cleanup; }
+    return seq;
+
+cleanup:
+    free_SEQ(seq);
+    return NULL;
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _FRAGFORMAT_H
+#define _FRAGFORMAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sequence.h"
+#include "outbuf.h"
+
+/* Binary stream of library fragments, written by simLibrary and read by
+ * simNGS in place of fasta.
+ * The stream starts with a header and is followed by records, everything
+ * in host byte order. Each record starts with its type and the number of
+ * bytes that follow, a multiple of four, so unknown records can be skipped.
+ *
+ * Source record (FRAGFORMAT_SOURCE), before the fragments of a sequence:
+ *   char name[]            Name of sequence, padded with nuls
+ *
+ * Fragment record (FRAGFORMAT_FRAGMENT):
+ *   uint32_t idx           Number of fragment, from one
+ *   uint32_t loc, srclen   Start of fragment in sequence, from zero, and
+ *                          bases of sequence covered
+ *   uint32_t length        Bases in fragment, after mutation
+ *   uint32_t nop, nrun     Operations of cigar and runs of ambiguous bases
+ *   char strand            '+' or '-', then three bytes of padding
+ *   uint32_t cigar[nop]    Length<<4 | op, op indexing "MIDNSHP=X" as BAM
+ *   uint32_t run[nrun][2]  Start and length of ambiguous runs, in order
+ *   uint8_t bases[]        Base i in bits 2(i%4) of byte i/4
+ * Bases and cigar are in the orientation of the fragment, reverse
+ * complemented for the '-' strand. The name of the fragment is made from
+ * the source name and coordinates in the format given in the header.
+ */
+#define FRAGFORMAT_MAGIC "simNGSf"
+#define FRAGFORMAT_BYTEORDER 0x01020304
+#define FRAGFORMAT_VERSION 1
+
+enum fragformat_record { FRAGFORMAT_SOURCE=1, FRAGFORMAT_FRAGMENT };
+enum fragformat_name { FRAGNAME_FASTA=0, FRAGNAME_CASAVA };
+
+typedef struct {
+    char magic[8];
+    uint32_t byteorder, version;
+    uint32_t namefmt, reserved;
+} FRAGHEADER;
+
+void append_fragname(OUTBUF out, const char * name, const unsigned int idx, const char strand, const uint32_t loc, const uint32_t fraglen, CSTRING fmt);
+
+FRAGHEADER new_FRAGHEADER( const CSTRING namefmt);
+bool is_FRAGFORMAT( const char * buf, const size_t len);
+bool check_FRAGHEADER( const FRAGHEADER * header);
+void append_FRAGHEADER( OUTBUF out, const FRAGHEADER * header);
+void append_source_FRAGFORMAT( OUTBUF out, const char * name);
+void append_fragment_FRAGFORMAT( OUTBUF out, const uint32_t idx, const uint32_t loc, const uint32_t srclen, const char strand, const NUC * nucs, const uint32_t length, const CIGLIST * cigar);
+/* Fields of a fragment record. Cigar, runs and bases are left packed in the
+ * record, which must outlive the view.
+ */
+typedef struct {
+    uint32_t idx, loc, srclen, length, nop, nrun;
+    char strand;
+    const char * cigar, * run;
+    const uint8_t * bases;
+} FRAGVIEW;
+
+bool view_FRAGFORMAT( const char * rec, const uint32_t reclen, FRAGVIEW * view);
+void append_name_FRAGVIEW( OUTBUF out, const FRAGHEADER * header, const char * source, const FRAGVIEW * view);
+bool nucs_from_FRAGVIEW( const FRAGVIEW * view, NUC * nucs);
+bool cigar_from_FRAGVIEW( const FRAGVIEW * view, CIGLIST * cigar);
+SEQ sequence_from_FRAGFORMAT( const FRAGHEADER * header, const char * source, const char * rec, const uint32_t reclen, OUTBUF scratch);
+
+#endif
@@ -20,18 +20,118 @@
  */
 
 #include <string.h>
+#include <float.h>
 #include <tgmath.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 #include "intensities.h"
 #include "random.h"
 #include "nuc.h"
 #include "normal.h"
 #include "lambda_distribution.h"
+#include "mixnormal.h"
 #include "elliptic.h"
 
 #define MODEL_FILE_VERSION 5
 
+/* Compiled runfiles hold a MODEL as calculated by new_MODEL so that it can
+ * be loaded without parsing text or repeating the factorisations.
+ * Header is followed by sections, each padded to a multiple of eight bytes:
+ *   label (nul terminated), parameters of dist1 and dist2 (real_t,
+ *   layout used by new_Distribution), then for each end the covariance,
+ *   the per-cycle factors and the precisions, each as uint32_t nrow, ncol
+ *   followed by the elements. The factors are stored as the packed
+ *   CYCLEFACTORS slab, nrow = 2*NTRI and ncol = ncycle.
+ * Everything is in host byte order and crc is the CRC-32 of all sections.
+ */
+#define RUNFILE_MAGIC "simNGSr"
+#define RUNFILE_BYTEORDER 0x01020304
+#define RUNFILE_VERSION 3
+
+typedef struct {
+    char magic[8];
+    uint32_t byteorder, version, realsize, model_version;
+    uint32_t ncycle, nend, labellen;
+    uint32_t nparam[2];     // Zero if no distribution
+    char key[2], pad[2];
+    uint32_t crc;
+    uint64_t datalen;
+} RUNHEADER;
+
+#define CYCLEFACTORS_ALIGN 64
+
+CYCLEFACTORS new_CYCLEFACTORS( const uint32_t ncycle){
+    validate(ncycle>0,NULL);
+    CYCLEFACTORS factors = calloc(1,sizeof(*factors));
+    validate(NULL!=factors,NULL);
+    factors->ncycle = ncycle;
+    size_t size = 2*NTRI*ncycle*sizeof(real_t);
+    size = (size+CYCLEFACTORS_ALIGN-1) & ~(size_t)(CYCLEFACTORS_ALIGN-1);
+    if( 0!=posix_memalign((void **)&factors->chol,CYCLEFACTORS_ALIGN,size) ){
+        free(factors);
+        return NULL;
+    }
+    factors->invchol = factors->chol + NTRI*ncycle;
+    return factors;
+}
+
+void free_CYCLEFACTORS( CYCLEFACTORS factors){
+    if(NULL==factors){ return; }
+    free(factors->chol);
+    free(factors);
+}
+
+CYCLEFACTORS copy_CYCLEFACTORS( const CYCLEFACTORS factors){
+    validate(NULL!=factors,NULL);
+    CYCLEFACTORS newfactors = new_CYCLEFACTORS(factors->ncycle);
+    validate(NULL!=newfactors,NULL);
+    memcpy(newfactors->chol,factors->chol,2*NTRI*factors->ncycle*sizeof(real_t));
+    return newfactors;
+}
+
+/* Factorisations of the covariance of each cycle for cycles [from,to):
+ * Cholesky factor of block and its inverse.
+ */
+static void factorise_cycles( const MAT cov, const uint32_t from, const uint32_t to, CYCLEFACTORS factors){
+    const uint32_t n = cov->nrow;
+    real_t x[NBASE*NBASE];
+    struct _matrix_str block = {NBASE,NBASE,x};
+    for ( uint32_t cy=from ; cy<to ; cy++){
+        for ( uint32_t col=0 ; col<NBASE ; col++){
+            for ( uint32_t row=0 ; row<NBASE ; row++){
+                x[col*NBASE+row] = cov->x[(cy*NBASE+col)*n + cy*NBASE+row];
+            }
+        }
+        cholesky(&block);
+        pack_lower_MAT(&block,factors->chol+cy*NTRI);
+        invert_cholesky(&block);
+        pack_lower_MAT(&block,factors->invchol+cy*NTRI);
+    }
+}
+
+/* Per-cycle factors and precisions for one end. Cycles before "from" are
+ * copied from an existing model, which must have at least that many.
+ */
+static bool cycle_factors_MODEL( const MAT cov, const uint32_t ncycle, const uint32_t from, const CYCLEFACTORS old, CYCLEFACTORS * factors, MAT * prec){
+    *factors = new_CYCLEFACTORS(ncycle);
+    if(NULL==*factors){ return false; }
+    if(from>0){
+        memcpy((*factors)->chol,old->chol,from*NTRI*sizeof(real_t));
+        memcpy((*factors)->invchol,old->invchol,from*NTRI*sizeof(real_t));
+    }
+    factorise_cycles(cov,from,ncycle,*factors);
+    *prec = precision_from_invchol((*factors)->invchol,ncycle);
+    return (NULL!=*prec);
+}
+
+/* Model for given covariances. Only the per-cycle factorisations used for
+ * simulation and calling are calculated.
+ */
 MODEL new_MODEL(const char * label, const Distribution dist1, const Distribution dist2, const MAT cov1, const MAT cov2){
     validate(NULL!=cov1,NULL);
     validate(NULL!=dist1,NULL);
@@ -50,19 +150,7 @@ MODEL new_MODEL(const char * label, const Distribution dist1, const Distribution
     
     model->cov1 = copy_MAT(cov1);
     if(NULL==model->cov1){ goto cleanup; }
-    model->chol1 = copy_MAT(cov1);
-    if(NULL==model->chol1){ goto cleanup; }
-    cholesky(model->chol1);
-    // Split covariance into cycle
-    model->chol1_cycle = block_diagonal_MAT(model->cov1,NBASE);
-    if(NULL==model->chol1_cycle){ goto cleanup; }
-    model->invchol1 = block_diagonal_MAT(model->cov1,NBASE);
-    if(NULL==model->invchol1){ goto cleanup; }
-    for ( uint32_t i=0 ; i<ncycle ; i++){
-	cholesky(model->chol1_cycle[i]);
-        cholesky(model->invchol1[i]);
-        invert_cholesky(model->invchol1[i]);
-    }
+    if(!cycle_factors_MODEL(model->cov1,ncycle,0,NULL,&model->factors1,&model->prec1)){ goto cleanup; }
    
     // If variance for second end is not given, make it equal to first 
     if( NULL!=cov2 ){
@@ -70,20 +158,7 @@ MODEL new_MODEL(const char * label, const Distribution dist1, const Distribution
     	model->paired = true;
     	model->cov2 = copy_MAT(cov2);
     	if(NULL==model->cov2){ goto cleanup; }
-
-    	model->chol2 = copy_MAT(cov2);
-    	if(NULL==model->chol2){ goto cleanup; }
-    	cholesky(model->chol2);
-
-    	model->chol2_cycle = block_diagonal_MAT(model->cov2,NBASE);
-    	if(NULL==model->chol2_cycle){ goto cleanup; }       
-    	model->invchol2 = block_diagonal_MAT(model->cov2,NBASE);
-    	if(NULL==model->invchol2){ goto cleanup; }
-    	for ( uint32_t i=0 ; i<ncycle ; i++){
-        	cholesky(model->chol2_cycle[i]);
-        	cholesky(model->invchol2[i]);
-        	invert_cholesky(model->invchol2[i]);
-    	}
+        if(!cycle_factors_MODEL(model->cov2,ncycle,0,NULL,&model->factors2,&model->prec2)){ goto cleanup; }
     }
     
     model->dist1 = copy_Distribution(dist1);
@@ -96,34 +171,43 @@ cleanup:
     return NULL;
 }
 
+/* Second end of model uses the same matrices as the first */
+void share_ends_MODEL( MODEL model){
+    validate(NULL!=model,);
+    model->paired = true;
+    model->cov2 = model->cov1;
+    model->factors2 = model->factors1;
+    model->prec2 = model->prec1;
+}
+
+static inline bool shared_ends_MODEL( const MODEL model){
+    return NULL!=model->cov1 && model->cov1==model->cov2;
+}
+
+/* Model no longer has a second end. Its matrices are released unless they
+ * are shared with the first.
+ */
+void single_end_MODEL( MODEL model){
+    validate(NULL!=model,);
+    if(model->cov2!=model->cov1){ free_MAT(model->cov2); }
+    if(model->prec2!=model->prec1){ free_MAT(model->prec2); }
+    if(model->factors2!=model->factors1){ free_CYCLEFACTORS(model->factors2); }
+    model->cov2 = model->prec2 = NULL;
+    model->factors2 = NULL;
+    model->paired = false;
+}
+
 void free_MODEL( MODEL model){
     validate(NULL!=model,);
+    // Matrices of second end may be those of the first
+    if(model->cov2!=model->cov1){ free_MAT(model->cov2); }
+    if(model->prec2!=model->prec1){ free_MAT(model->prec2); }
+    if(model->factors2!=model->factors1){ free_CYCLEFACTORS(model->factors2); }
     free_MAT(model->cov1);
-    free_MAT(model->chol1);
-    if(NULL!=model->invchol1){
-        for( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-            free_MAT(model->chol1_cycle[i]);
-            free_MAT(model->invchol1[i]);
-        }
-	safe_free(model->chol1_cycle);
-        safe_free(model->invchol1);
-    }
+    free_MAT(model->prec1);
+    free_CYCLEFACTORS(model->factors1);
     free_Distribution(model->dist1);
     free_Distribution(model->dist2);
-    free_MAT(model->cov2);
-    free_MAT(model->chol2);
-    if(NULL!=model->invchol2){
-        for( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-	    free_MAT(model->invchol2[i]);
-        }
-	safe_free(model->invchol2);
-    }
-    if(NULL!=model->chol2_cycle){
-	    for( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-		    free_MAT(model->chol2_cycle[i]);
-	    }
-	    safe_free(model->chol2_cycle);
-    }
     safe_free(model->label);
     safe_free(model);
 }
@@ -135,44 +219,27 @@ MODEL copy_MODEL( const MODEL model){
     newmodel->orig_ncycle = model->orig_ncycle;
     newmodel->dist1     = copy_Distribution(model->dist1);
     newmodel->dist2     = copy_Distribution(model->dist2);
-    if(NULL==newmodel->dist2){ goto cleanup; }
-    if(NULL==newmodel->dist2){ goto cleanup; }
+    if(NULL!=model->dist1 && NULL==newmodel->dist1){ goto cleanup; }
+    if(NULL!=model->dist2 && NULL==newmodel->dist2){ goto cleanup; }
     newmodel->paired    = model->paired;
 
     newmodel->cov1       = copy_MAT(model->cov1);
     if(NULL==newmodel->cov1){ goto cleanup; }
-    newmodel->chol1      = copy_MAT(model->chol1);
-    if(NULL==newmodel->chol1){ goto cleanup; }
-    newmodel->invchol1    = calloc(model->orig_ncycle,sizeof(*newmodel->invchol1));
-    if(NULL==newmodel->invchol1){ goto cleanup; }
-    for ( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-        newmodel->invchol1[i]   = copy_MAT(model->invchol1[i]);
-        if(NULL==newmodel->invchol1[i]){ goto cleanup; }
-    }
-    newmodel->chol1_cycle    = calloc(model->orig_ncycle,sizeof(*newmodel->chol1_cycle));
-    if(NULL==newmodel->chol1_cycle){ goto cleanup; }
-    for ( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-        newmodel->chol1_cycle[i]   = copy_MAT(model->chol1_cycle[i]);
-        if(NULL==newmodel->chol1_cycle[i]){ goto cleanup; }
-    }
+    newmodel->factors1    = copy_CYCLEFACTORS(model->factors1);
+    if(NULL==newmodel->factors1){ goto cleanup; }
+    newmodel->prec1      = copy_MAT(model->prec1);
+    if(NULL==newmodel->prec1){ goto cleanup; }
    
-    if(NULL!=model->cov2){
+    if(shared_ends_MODEL(model)){
+        share_ends_MODEL(newmodel);
+        newmodel->paired = model->paired;
+    } else if(NULL!=model->cov2){
     	newmodel->cov2       = copy_MAT(model->cov2);
     	if(NULL==newmodel->cov2){ goto cleanup; }
-    	newmodel->chol2      = copy_MAT(model->chol2);
-    	if(NULL==newmodel->chol2){ goto cleanup; }
-    	newmodel->invchol2    = calloc(model->orig_ncycle,sizeof(*newmodel->invchol2));
-    	if(NULL==newmodel->invchol2){ goto cleanup; }
-    	for ( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-        	newmodel->invchol2[i]   = copy_MAT(model->invchol2[i]);
-        	if(NULL==newmodel->invchol2[i]){ goto cleanup; }
-    	}
-    	newmodel->chol2_cycle    = calloc(model->orig_ncycle,sizeof(*newmodel->chol2_cycle));
-    	if(NULL==newmodel->chol2_cycle){ goto cleanup; }
-    	for ( uint32_t i=0 ; i<model->orig_ncycle ; i++){
-        	newmodel->chol2_cycle[i]   = copy_MAT(model->chol2_cycle[i]);
-        	if(NULL==newmodel->chol2_cycle[i]){ goto cleanup; }
-    	}
+    	newmodel->factors2    = copy_CYCLEFACTORS(model->factors2);
+    	if(NULL==newmodel->factors2){ goto cleanup; }
+    	newmodel->prec2      = copy_MAT(model->prec2);
+    	if(NULL==newmodel->prec2){ goto cleanup; }
     }
     
     if(NULL!=model->label){
@@ -269,15 +336,34 @@ MODEL new_MODEL_from_fp( FILE * fp){
     return model;
 }
 
+/* Leading ncycle cycles of covariance, with variance of final cycle scaled */
+static MAT trim_covariance( const MAT cov, const uint32_t ncycle, const real_t final_factor[4]){
+	const uint32_t n = NBASE*ncycle;
+	MAT trimmed = new_MAT(n,n);
+	if(NULL==trimmed){ return NULL; }
+	for ( uint32_t col=0 ; col<n ; col++){
+		memcpy(trimmed->x+col*n,cov->x+col*cov->nrow,n*sizeof(real_t));
+	}
+	const size_t off = n - NBASE;
+	for ( int i=0 ; i<NBASE ; i++){
+		for ( int j=0 ; j<n ; j++){
+			trimmed->x[(off+i)*n+j] *= final_factor[i];
+			trimmed->x[j*n+off+i] *= final_factor[i];
+		}
+	}
+	return trimmed;
+}
+
+/* Model for the first ncycle cycles. The factorisations of every cycle but
+ * the last, whose variance may be rescaled, are unchanged so are copied
+ * rather than recalculated. If nothing changes, the model itself is
+ * returned rather than a copy.
+ */
 MODEL trim_MODEL(const uint32_t ncycle, real_t final_factor[4], const MODEL model){
 	MODEL newmod = NULL;
-	MAT trimmedVar1=NULL, trimmedVar2=NULL;
 	validate(NULL!=model,NULL);
+	validate(ncycle>0,NULL);
 	if(model->ncycle<ncycle){ return NULL; }
-	trimmedVar1 = copy_MAT(trim_MAT(model->cov1,NBASE*ncycle,NBASE*ncycle,true));
-	if(NULL==trimmedVar1){ goto cleanup; }
-	trimmedVar2 = copy_MAT(trim_MAT(model->cov2,NBASE*ncycle,NBASE*ncycle,true));
-        if(NULL!=model->cov2 && NULL==trimmedVar2){ goto cleanup; }
 
 	// Alter covariance matrices
 	if(final_factor[0]==-1.0){
@@ -286,12 +372,13 @@ MODEL trim_MODEL(const uint32_t ncycle, real_t final_factor[4], const MODEL mode
 			final_factor[0] = final_factor[1] = final_factor[2] = final_factor[3] = 1.0;
 		} else {
 			// Learn scaling
+			const size_t n = model->cov1->nrow;
 			const size_t off1 = model->ncycle * 4 - 4;
 			const size_t off2 = model->ncycle * 4 - 8;
 			for ( int i=0 ; i<4 ; i++){
-				final_factor[i] = model->cov1->x[(off1+i)*4*model->ncycle + off1+i] / model->cov1->x[(off2+i)*4*model->ncycle + off2+i];
+				final_factor[i] = model->cov1->x[(off1+i)*n + off1+i] / model->cov1->x[(off2+i)*n + off2+i];
 				if(NULL!=model->cov2){
-					final_factor[i] += model->cov2->x[(off1+i)*4*model->ncycle + off1+i] / model->cov2->x[(off2+i)*4*model->ncycle + off2+i];
+					final_factor[i] += model->cov2->x[(off1+i)*n + off1+i] / model->cov2->x[(off2+i)*n + off2+i];
 					final_factor[i] /= 2;
 				}
 			}
@@ -299,44 +386,268 @@ MODEL trim_MODEL(const uint32_t ncycle, real_t final_factor[4], const MODEL mode
 	}
 	// Scale matrices
 	fprintf(stderr,"Scaling variance of final cycle by %f %f %f %f\n",final_factor[0] , final_factor[1] , final_factor[2] , final_factor[3] );
-	const size_t off = (ncycle * 4 - 4);
+	if(ncycle==model->ncycle && 1.0==final_factor[0] && 1.0==final_factor[1] && 1.0==final_factor[2] && 1.0==final_factor[3]){
+		// Nothing changes so no need to repeat factorisations
+		return model;
+	}
 	for ( int i=0 ; i<4 ; i++){
 		final_factor[i] = sqrt(final_factor[i]);
-		for ( int j=0 ; j<ncycle*4 ; j++){
-			trimmedVar1->x[(off+i)*4*ncycle+j] *= final_factor[i];
-			trimmedVar1->x[j*ncycle*4+off+i] *= final_factor[i];
-			if(NULL!=trimmedVar2){
-				trimmedVar2->x[(off+i)*4*ncycle+j] *= final_factor[i];
-				trimmedVar2->x[off+i+4*ncycle*j] *= final_factor[i];
-			}
-		}
 	}
 
-	newmod = new_MODEL(model->label,model->dist1,model->dist2,trimmedVar1,trimmedVar2);
-	if(NULL==newmod){goto cleanup;}
+	newmod = calloc(1,sizeof(*newmod));
+	if(NULL==newmod){ return NULL; }
+	newmod->ncycle = newmod->orig_ncycle = ncycle;
+	if(NULL!=model->label){
+		newmod->label = calloc(1+strlen(model->label),sizeof(char));
+		if(NULL==newmod->label){ goto cleanup; }
+		strcpy(newmod->label,model->label);
+	}
+	newmod->dist1 = copy_Distribution(model->dist1);
+	newmod->dist2 = copy_Distribution(model->dist2);
 
-	free_MAT(trimmedVar2);
-	free_MAT(trimmedVar1);
+	newmod->cov1 = trim_covariance(model->cov1,ncycle,final_factor);
+	if(NULL==newmod->cov1){ goto cleanup; }
+	if(!cycle_factors_MODEL(newmod->cov1,ncycle,ncycle-1,model->factors1,&newmod->factors1,&newmod->prec1)){ goto cleanup; }
+	if(shared_ends_MODEL(model)){
+		share_ends_MODEL(newmod);
+	} else if(NULL!=model->cov2){
+		newmod->cov2 = trim_covariance(model->cov2,ncycle,final_factor);
+		if(NULL==newmod->cov2){ goto cleanup; }
+		if(!cycle_factors_MODEL(newmod->cov2,ncycle,ncycle-1,model->factors2,&newmod->factors2,&newmod->prec2)){ goto cleanup; }
+	}
+	newmod->paired = (NULL!=newmod->cov2);
 	return newmod;
 
 cleanup:
 	free_MODEL(newmod);
-	free_MAT(trimmedVar2);
-	free_MAT(trimmedVar1);
 	return NULL;
 }
 
+/* Either a text or compiled runfile */
 MODEL new_MODEL_from_file( const CSTRING filename ){
     FILE * fp = fopen(filename,"r");
     validate(NULL!=fp,NULL);
+    char magic[sizeof(RUNFILE_MAGIC)];
+    const bool compiled = (1==fread(magic,sizeof(magic),1,fp) && 0==memcmp(magic,RUNFILE_MAGIC,sizeof(magic)));
+    if(compiled){
+        fclose(fp);
+        return new_MODEL_from_compiled(filename);
+    }
+    rewind(fp);
     MODEL model = new_MODEL_from_fp( fp);
     fclose(fp);
     return model;
 }
 
+/* Parameters of distribution in the layout accepted by new_Distribution.
+ * If param is NULL, just returns the number of parameters.
+ */
+static uint32_t params_Distribution( const Distribution dist, real_t * param){
+    if(NULL==dist){ return 0; }
+    if('M'==dist->key){
+        const NormMixParam normmix = (NormMixParam)dist->info;
+        if(NULL!=param){
+            param[0] = normmix->nmix;
+            for ( uint32_t i=0,j=1 ; i<normmix->nmix ; i++){
+                param[j++] = normmix->prob[i];
+                param[j++] = normmix->mean[i];
+                param[j++] = normmix->sd[i];
+            }
+        }
+        return 1 + 3*normmix->nmix;
+    }
+    if(NULL!=param){ memcpy(param,dist->param,dist->np*sizeof(real_t)); }
+    return dist->np;
+}
+
+struct runwriter {
+    FILE * fp;
+    uint64_t len;
+    uLong crc;
+    bool ok;
+};
+
+static void write_section( struct runwriter * w, const void * ptr, const size_t len){
+    static const char zero[8] = {0};
+    const size_t pad = (8 - len%8) % 8;
+    w->ok &= (len==fwrite(ptr,1,len,w->fp)) && (pad==fwrite(zero,1,pad,w->fp));
+    w->crc = crc32(w->crc,ptr,len);
+    w->crc = crc32(w->crc,(const Bytef *)zero,pad);
+    w->len += len + pad;
+}
+
+static void write_MAT_section( struct runwriter * w, const MAT mat){
+    const uint32_t dim[2] = {mat->nrow,mat->ncol};
+    write_section(w,dim,sizeof(dim));
+    write_section(w,mat->x,(size_t)mat->nrow*mat->ncol*sizeof(real_t));
+}
+
+static void write_CYCLEFACTORS_section( struct runwriter * w, const CYCLEFACTORS factors){
+    const uint32_t dim[2] = {2*NTRI,factors->ncycle};
+    write_section(w,dim,sizeof(dim));
+    write_section(w,factors->chol,(size_t)dim[0]*dim[1]*sizeof(real_t));
+}
+
+/* Write model to file as a compiled runfile, returning false on failure */
+bool compile_MODEL( const MODEL model, const CSTRING filename){
+    validate(NULL!=model,false);
+    validate(NULL!=filename,false);
+    const char * label = (NULL!=model->label) ? model->label : "";
+    const Distribution dist[2] = {model->dist1,model->dist2};
+    RUNHEADER header = {
+        .magic = RUNFILE_MAGIC,
+        .byteorder = RUNFILE_BYTEORDER,
+        .version = RUNFILE_VERSION,
+        .realsize = sizeof(real_t),
+        .model_version = MODEL_FILE_VERSION,
+        .ncycle = model->ncycle,
+        .nend = (NULL!=model->cov2) ? 2 : 1,
+        .labellen = strlen(label) + 1
+    };
+    struct runwriter w = { .fp = fopen(filename,"wb"), .len = 0, .crc = crc32(0L,Z_NULL,0), .ok = true };
+    if(NULL==w.fp){ return false; }
+
+    // Header is rewritten once length and checksum are known
+    w.ok &= (1==fwrite(&header,sizeof(header),1,w.fp));
+    write_section(&w,label,header.labellen);
+    for ( int i=0 ; i<2 ; i++){
+        header.nparam[i] = params_Distribution(dist[i],NULL);
+        if(0==header.nparam[i]){ continue; }
+        header.key[i] = dist[i]->key;
+        real_t param[header.nparam[i]];
+        params_Distribution(dist[i],param);
+        write_section(&w,param,sizeof(param));
+    }
+    const MAT cov[2] = {model->cov1,model->cov2};
+    const CYCLEFACTORS factors[2] = {model->factors1,model->factors2};
+    const MAT prec[2] = {model->prec1,model->prec2};
+    for ( uint32_t end=0 ; end<header.nend ; end++){
+        if(NULL==factors[end] || NULL==prec[end]){ w.ok = false; break; }
+        write_MAT_section(&w,cov[end]);
+        write_CYCLEFACTORS_section(&w,factors[end]);
+        write_MAT_section(&w,prec[end]);
+    }
+
+    header.crc = w.crc;
+    header.datalen = w.len;
+    w.ok &= (0==fseek(w.fp,0,SEEK_SET)) && (1==fwrite(&header,sizeof(header),1,w.fp));
+    w.ok &= (0==fclose(w.fp));
+    return w.ok;
+}
+
+struct runreader {
+    const char * ptr;
+    uint64_t left;
+};
+
+static const void * read_section( struct runreader * r, const uint64_t len){
+    const uint64_t padlen = len + (8 - len%8) % 8;
+    if(padlen>r->left){ return NULL; }
+    const void * ptr = r->ptr;
+    r->ptr += padlen;
+    r->left -= padlen;
+    return ptr;
+}
+
+static MAT read_MAT_section( struct runreader * r){
+    const uint32_t * dim = read_section(r,2*sizeof(uint32_t));
+    if(NULL==dim){ return NULL; }
+    const real_t * x = read_section(r,(uint64_t)dim[0]*dim[1]*sizeof(real_t));
+    if(NULL==x){ return NULL; }
+    MAT mat = new_MAT(dim[0],dim[1]);
+    if(NULL==mat){ return NULL; }
+    memcpy(mat->x,x,(size_t)dim[0]*dim[1]*sizeof(real_t));
+    return mat;
+}
+
+static CYCLEFACTORS read_CYCLEFACTORS_section( struct runreader * r, const uint32_t ncycle){
+    const uint32_t * dim = read_section(r,2*sizeof(uint32_t));
+    if(NULL==dim || 2*NTRI!=dim[0] || ncycle!=dim[1]){ return NULL; }
+    const real_t * x = read_section(r,(uint64_t)dim[0]*dim[1]*sizeof(real_t));
+    if(NULL==x){ return NULL; }
+    CYCLEFACTORS factors = new_CYCLEFACTORS(ncycle);
+    if(NULL==factors){ return NULL; }
+    memcpy(factors->chol,x,(size_t)dim[0]*dim[1]*sizeof(real_t));
+    return factors;
+}
+
+/* Load a compiled runfile written by compile_MODEL. The file is memory
+ * mapped and checked against its checksum before use.
+ */
+MODEL new_MODEL_from_compiled( const CSTRING filename){
+    validate(NULL!=filename,NULL);
+    MODEL model = NULL;
+    const int fd = open(filename,O_RDONLY);
+    if(fd<0){ return NULL; }
+    struct stat st;
+    if(0!=fstat(fd,&st) || st.st_size<(off_t)sizeof(RUNHEADER)){ close(fd); return NULL; }
+    const size_t maplen = st.st_size;
+    const char * map = mmap(NULL,maplen,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(MAP_FAILED==map){ return NULL; }
+
+    RUNHEADER header;
+    memcpy(&header,map,sizeof(header));
+    if(0!=memcmp(header.magic,RUNFILE_MAGIC,sizeof(RUNFILE_MAGIC))
+       || RUNFILE_BYTEORDER!=header.byteorder || RUNFILE_VERSION!=header.version){
+        warnx("Compiled runfile \"%s\" is of an unsupported version or byte order",filename);
+        goto cleanup;
+    }
+    if(sizeof(real_t)!=header.realsize || MODEL_FILE_VERSION!=header.model_version){
+        warnx("Compiled runfile \"%s\" was created by an incompatible build of simNGS",filename);
+        goto cleanup;
+    }
+    if(header.datalen!=maplen-sizeof(header) || header.nend<1 || header.nend>2 || 0==header.labellen){
+        warnx("Compiled runfile \"%s\" is truncated or corrupt",filename);
+        goto cleanup;
+    }
+    struct runreader r = { .ptr = map + sizeof(header), .left = header.datalen };
+    if(header.crc!=crc32(crc32(0L,Z_NULL,0),(const Bytef *)r.ptr,header.datalen)){
+        warnx("Checksum of compiled runfile \"%s\" is incorrect",filename);
+        goto cleanup;
+    }
+
+    model = calloc(1,sizeof(*model));
+    if(NULL==model){ goto cleanup; }
+    model->ncycle = model->orig_ncycle = header.ncycle;
+    model->paired = (2==header.nend);
+    const char * label = read_section(&r,header.labellen);
+    if(NULL==label || '\0'!=label[header.labellen-1]){ goto fail; }
+    model->label = calloc(header.labellen,sizeof(char));
+    if(NULL==model->label){ goto fail; }
+    strcpy(model->label,label);
+    Distribution * dist[2] = {&model->dist1,&model->dist2};
+    for ( int i=0 ; i<2 ; i++){
+        if(0==header.nparam[i]){ continue; }
+        const real_t * param = read_section(&r,header.nparam[i]*sizeof(real_t));
+        if(NULL==param){ goto fail; }
+        *dist[i] = new_Distribution(header.key[i],param);
+        if(NULL==*dist[i]){ goto fail; }
+        if('M'==header.key[i]){ (*dist[i])->np = header.nparam[i] - 2; }
+    }
+    MAT * cov[2] = {&model->cov1,&model->cov2};
+    CYCLEFACTORS * factors[2] = {&model->factors1,&model->factors2};
+    MAT * prec[2] = {&model->prec1,&model->prec2};
+    for ( uint32_t end=0 ; end<header.nend ; end++){
+        if(NULL==(*cov[end] = read_MAT_section(&r))){ goto fail; }
+        if(NULL==(*factors[end] = read_CYCLEFACTORS_section(&r,header.ncycle))){ goto fail; }
+        if(NULL==(*prec[end] = read_MAT_section(&r))){ goto fail; }
+    }
+    munmap((void *)map,maplen);
+    return model;
+
+fail:
+    warnx("Compiled runfile \"%s\" is corrupt",filename);
+    free_MODEL(model);
+    model = NULL;
+cleanup:
+    munmap((void *)map,maplen);
+    return model;
+}
+
 MAT generate_pure_intensities ( 
     const real_t sdfact, const real_t lambda, const ARRAY(NUC) seq, 
-    const ARRAY(NUC) adapter, const uint32_t ncycle, const MAT * chol, 
+    const ARRAY(NUC) adapter, const uint32_t ncycle, const real_t * chol, 
     const real_t dustProb, const MAT invA, const MAT N, MAT ints){
     validate(NULL!=seq.elt,NULL);
     validate(NULL!=chol,NULL);
@@ -402,11 +713,76 @@ real_t lss ( const MAT x, const MAT invVchol ){
     }
     return tot;
 }
+
+/* As lss, for a single cycle whose inverse Cholesky factor is packed */
+static inline real_t lss_packed( const real_t * x, const real_t * invchol){
+    real_t tot = 0.;
+    for ( uint32_t i=0 ; i<NBASE ; i++){
+        real_t s = 0.;
+        for ( uint32_t j=i ; j<NBASE ; j++){
+            s += x[j] * invchol[TRI_INDEX(j,i)];
+        }
+        tot += s*s;
+    }
+    return tot;
+}
     
     
-MAT likelihood_cycle_intensities ( const real_t sdfact, real_t mu, const real_t lambda, const MAT ints, const MAT * invchol, MAT like){
-    validate(NULL!=ints,NULL);
+/* Precision matrices P = invchol^t invchol for each cycle, stored as columns
+ * of a NBASE*NBASE x ncycle matrix, from packed inverse Cholesky factors.
+ */
+MAT precision_from_invchol( const real_t * invchol, const uint32_t ncycle){
     validate(NULL!=invchol,NULL);
+    MAT prec = new_MAT(NBASE*NBASE,ncycle);
+    validate(NULL!=prec,NULL);
+    for ( uint32_t cy=0 ; cy<ncycle ; cy++){
+        const real_t * a = invchol + cy*NTRI;
+        real_t * p = prec->x + cy*NBASE*NBASE;
+        for ( uint32_t j=0 ; j<NBASE ; j++){
+            for ( uint32_t k=0 ; k<NBASE ; k++){
+                const uint32_t m = (j<k)?j:k;
+                real_t s = 0.;
+                for ( uint32_t i=0 ; i<=m ; i++){
+                    s += a[TRI_INDEX(j,i)] * a[TRI_INDEX(k,i)];
+                }
+                p[j*NBASE+k] = s;
+            }
+        }
+    }
+    return prec;
+}
+
+/* Minus log-likelihood of each base for a single cycle, given the cycle's
+ * precision matrix. Not robustified.
+ */
+static inline void likelihood_cycle_prec( const real_t * x, const real_t * p, const real_t lambda, const real_t isd2, const real_t logmean, const real_t logsd, real_t * l){
+    real_t px[NBASE];
+    real_t xpx = 0.;
+    for ( uint32_t j=0 ; j<NBASE ; j++){
+        real_t s = 0.;
+        for ( uint32_t k=0 ; k<NBASE ; k++){
+            s += p[j*NBASE+k] * x[k];
+        }
+        px[j] = s;
+        xpx += s * x[j];
+    }
+    for ( uint32_t j=0 ; j<NBASE ; j++){
+        real_t t = (xpx - 2.0*lambda*px[j] + lambda*lambda*p[j*NBASE+j]) * isd2;
+        if(t<DBL_MIN){ t = DBL_MIN; } // Rounding when intensities are very close to mean
+        real_t del = (log(t)-logmean)/logsd;
+        l[j] = del*del/2.0 + 2.0 * log(t);
+    }
+}
+
+/* Likelihood of each base at each cycle.
+ * If prec is given, the quadratic form for x - lambda e_j is expanded as
+ *   x^t P x - 2 lambda (P x)_j + lambda^2 P_jj
+ * so only one matrix-vector product is required per cycle. Otherwise lss is
+ * called for each base.
+ */
+MAT likelihood_cycle_intensities ( const real_t sdfact, real_t mu, const real_t lambda, const MAT ints, const real_t * invchol, const MAT prec, MAT like){
+    validate(NULL!=ints,NULL);
+    validate(NULL!=invchol || NULL!=prec,NULL);
     const uint32_t ncycle = ints->ncol;
     const real_t logsd = 1.088;
     const real_t logmean = log(NBASE)-logsd*logsd*0.5;
@@ -417,19 +793,27 @@ MAT likelihood_cycle_intensities ( const real_t sdfact, real_t mu, const real_t
         validate(NULL!=like,NULL);
     }
     
-    MAT tmp = new_MAT(NBASE,1);
-    for ( int i=0 ; i<ncycle ; i++){
-        for ( int j=0 ; j<NBASE ; j++){
-            memcpy(tmp->x,ints->x+i*NBASE,NBASE*sizeof(real_t));
-            tmp->x[j] -= lambda;
-            //like->x[i*NBASE+j] = -dchisq4(lss(tmp,invchol[i])/(sdfact*sdfact),true);
-            // log-likelihood of log-normal distribution
- 	    real_t t = lss(tmp,invchol[i])/(sdfact*sdfact);
- 	    real_t del = (log(t)-logmean)/logsd;
- 	    like->x[i*NBASE+j] = del*del/2.0 + 2.0 * log(t); // + logsd*logsd - 2.0*logmean;
-
+    if(NULL!=prec){
+        validate(prec->ncol>=ncycle,NULL);
+        const real_t isd2 = 1.0/(sdfact*sdfact);
+        for ( uint32_t i=0 ; i<ncycle ; i++){
+            likelihood_cycle_prec(ints->x+i*NBASE,prec->x+i*NBASE*NBASE,lambda,isd2,logmean,logsd,like->x+i*NBASE);
+        }
+    } else {
+        real_t tmp[NBASE];
+        for ( int i=0 ; i<ncycle ; i++){
+            for ( int j=0 ; j<NBASE ; j++){
+                memcpy(tmp,ints->x+i*NBASE,NBASE*sizeof(real_t));
+                tmp[j] -= lambda;
+                // log-likelihood of log-normal distribution
+                real_t t = lss_packed(tmp,invchol+i*NTRI)/(sdfact*sdfact);
+                if(t<DBL_MIN){ t = DBL_MIN; } // As for precision matrices
+                real_t del = (log(t)-logmean)/logsd;
+                like->x[i*NBASE+j] = del*del/2.0 + 2.0 * log(t); // + logsd*logsd - 2.0*logmean;
+            }
         }
     }
+
     if(mu>0.0){
         const real_t log_mu = log(mu);
         for( uint32_t i=0 ; i<(ncycle*NBASE) ; i++){
@@ -438,7 +822,6 @@ MAT likelihood_cycle_intensities ( const real_t sdfact, real_t mu, const real_t
             like->x[i] = -log_mu - log1p( exp(-like->x[i]-log_mu) );
         }
     }
-    free_MAT(tmp);
     
     return like;
 }
@@ -450,11 +833,15 @@ void fprint_vector(FILE * fp, const CSTRING prefix, const CSTRING sep, const CST
     validate(NULL!=suffix,);
     validate(NULL!=x,);
 
+    char buf[REAL_E_MAXLEN+1];
     fputs(prefix,fp);
     if ( n>0){
-        fprintf(fp,"%e",x[0]);
+        format_real_e(buf,x[0]);
+        fputs(buf,fp);
         for ( uint32_t i=1 ; i<n ; i++){
-            fprintf(fp,"%s%e",sep,x[i]);
+            fputs(sep,fp);
+            format_real_e(buf,x[i]);
+            fputs(buf,fp);
         }
     }
     fputs(suffix,fp);
@@ -539,6 +926,54 @@ ARRAY(PHREDCHAR) quality_from_likelihood(const MAT likelihood, const ARRAY(NUC)
 }
 
 
+/* Calls and quality characters directly from intensities, without storing
+ * likelihoods. Equivalent to likelihood_cycle_intensities followed by
+ * call_by_maximum_likelihood and quality_from_likelihood, but the likelihoods
+ * for each cycle are kept in registers and exp(0) for the called base is not
+ * evaluated.
+ */
+bool call_cycle_intensities( const real_t sdfact, const real_t mu, const real_t lambda, const MAT ints, const MAT prec, const real_t generr, const bool doIllumina, ARRAY(NUC) * calls, ARRAY(PHREDCHAR) * quals){
+    validate(NULL!=ints,false);
+    validate(NULL!=prec,false);
+    validate(NULL!=calls,false);
+    validate(NULL!=quals,false);
+    const uint32_t ncycle = ints->ncol;
+    validate(prec->ncol>=ncycle,false);
+    const real_t logsd = 1.088;
+    const real_t logmean = log(NBASE)-logsd*logsd*0.5;
+    const real_t isd2 = 1.0/(sdfact*sdfact);
+    const real_t log_mu = (mu>0.0) ? log(mu) : 0.0;
+    if ( NULL==calls->elt){
+       *calls = new_ARRAY(NUC)(ncycle);
+       validate(NULL!=calls->elt,false);
+    }
+    if ( NULL==quals->elt){
+       *quals = new_ARRAY(PHREDCHAR)(ncycle);
+       validate(NULL!=quals->elt,false);
+    }
+
+    for ( uint32_t cycle=0 ; cycle<ncycle ; cycle++){
+        real_t l[NBASE];
+        likelihood_cycle_prec(ints->x+cycle*NBASE,prec->x+cycle*NBASE*NBASE,lambda,isd2,logmean,logsd,l);
+        if(mu>0.0){
+            for ( uint32_t b=0 ; b<NBASE ; b++){
+                l[b] = -log_mu - log1p( exp(-l[b]-log_mu) );
+            }
+        }
+        uint32_t mb = NUC_A;
+        for ( uint32_t b=1 ; b<NBASE ; b++){
+            if(l[b]<l[mb]){ mb = b; }
+        }
+        real_t tot = 0.;
+        for ( uint32_t b=0 ; b<NBASE ; b++){
+            tot += (b==mb) ? 1.0 : exp(l[mb]-l[b]);
+        }
+        calls->elt[cycle] = mb;
+        quals->elt[cycle] = phredchar_from_prob((1.0-generr)/tot,doIllumina);
+    }
+    return true;
+}
+
 real_t purity ( real_t * ints4 ){
     real_t max1=fabs(ints4[0]);
     real_t max2=fabs(ints4[1]);
@@ -27,31 +27,53 @@
 #include "nuc.h"
 #include "lambda_distribution.h"
 
+/* Factorisations of the covariance of each cycle: lower triangular Cholesky
+ * factors and their inverses, packed (see TRI_INDEX) with NTRI values per
+ * cycle. All are held in cycle order in one 64-byte aligned slab, the
+ * factors for every cycle followed by the inverses, so kernels stream
+ * through them without indirection.
+ */
+#define NTRI TRI_SIZE(NBASE)
+typedef struct {
+    uint32_t ncycle;
+    real_t * chol, * invchol;
+} * CYCLEFACTORS;
+
+CYCLEFACTORS new_CYCLEFACTORS( const uint32_t ncycle);
+void free_CYCLEFACTORS( CYCLEFACTORS factors);
+CYCLEFACTORS copy_CYCLEFACTORS( const CYCLEFACTORS factors);
+
 typedef struct {
     uint32_t ncycle,orig_ncycle;
     bool paired;    // Was read paired?
     MAT cov1,cov2;  // Covariance
-    MAT chol1,chol2;       // Cholesky factorisation of covariance
-    MAT * chol1_cycle, * chol2_cycle;
-    MAT *invchol1, *invchol2;    // Inverse of cholesky factorisation
+    CYCLEFACTORS factors1, factors2;    // Per-cycle factorisations
+    MAT prec1, prec2;       // Per-cycle precision matrices, one column per cycle
     Distribution dist1, dist2; // Distribution for lambda
     char * label;
 } * MODEL;
+// Matrices of the second end may be shared with the first, see share_ends_MODEL
 
 MODEL new_MODEL(const char * label, const Distribution dist1, const Distribution dist2, const MAT cov1, const MAT cov2);
 void free_MODEL(MODEL model);
 MODEL copy_MODEL(const MODEL model);
 void show_MODEL(FILE * fp, const MODEL model);
+void share_ends_MODEL( MODEL model);
+void single_end_MODEL( MODEL model);
 
 MODEL trim_MODEL(const uint32_t ncycle, real_t final_factor[4], const MODEL model);
 
 MODEL new_MODEL_from_fp( FILE * fp );
 MODEL new_MODEL_from_file( const CSTRING filename);
+MODEL new_MODEL_from_compiled( const CSTRING filename);
+bool compile_MODEL( const MODEL model, const CSTRING filename);
 
-MAT generate_pure_intensities ( const real_t varfact, const real_t lambda, const ARRAY(NUC) seq, const ARRAY(NUC) adapter, const uint32_t ncycle, const MAT * chol, const real_t dustProb, const MAT invA, const MAT N, MAT ints);
-MAT likelihood_cycle_intensities ( const real_t varfact, real_t mu, const real_t lambda, const MAT ints, const MAT invchol[], MAT like);
+MAT generate_pure_intensities ( const real_t varfact, const real_t lambda, const ARRAY(NUC) seq, const ARRAY(NUC) adapter, const uint32_t ncycle, const real_t * chol, const real_t dustProb, const MAT invA, const MAT N, MAT ints);
+MAT precision_from_invchol( const real_t * invchol, const uint32_t ncycle);
+MAT likelihood_cycle_intensities ( const real_t varfact, real_t mu, const real_t lambda, const MAT ints, const real_t * invchol, const MAT prec, MAT like);
 void fprint_intensities(FILE * fp, const char * prefix, const MAT ints, const bool last);
 ARRAY(NUC) call_by_maximum_likelihood(const MAT likelihood, ARRAY(NUC) calls);
+bool call_cycle_intensities( const real_t sdfact, const real_t mu, const real_t lambda, const MAT ints, const MAT prec, const real_t generr, const bool doIllumina, ARRAY(NUC) * calls, ARRAY(PHREDCHAR) * quals);
 ARRAY(PHREDCHAR) quality_from_likelihood(const MAT likelihood, const ARRAY(NUC) calls, const real_t generr, const bool doIllumina, ARRAY(PHREDCHAR) quals);
 uint32_t number_inpure_cycles( const MAT intensities, const real_t threshold, const uint32_t ncycle);
 
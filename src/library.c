@@ -0,0 +1,931 @@
+/*
+ *  Copyright (C) 2010 by Tim Massingham, European Bioinformatics Institute
+ *  tim.massingham@ebi.ac.uk
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <tgmath.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "library.h"
+#include "seqreader.h"
+#include "random.h"
+#include "normal.h"
+#include "pool.h"
+
+#define Q_(A) #A
+#define QUOTE(A) Q_(A)
+#define PROGNAME "simLibrary"
+#define PROGVERSION "1.4.1"
+
+uint32_t nfragment_from_coverage(const uint32_t genlen, const real_t coverage, const uint32_t readlen, const bool paired){
+    const uint32_t bases_per_read = paired?(2*readlen):readlen;
+    return (uint32_t)(0.5+(genlen*coverage)/bases_per_read);
+}
+
+void fprint_usage_LIBOPT( FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+"\t\"" PROGNAME "\"\n"
+"Split sequence into a simulated library of fragments\n"
+"\n"
+"Usage:\n"
+"\t" PROGNAME " [-b bias] [-c cov] [-g lower:upper] [-i insertlen]\n"
+"\t           [-m multiplier_file] [-n nfragments] -p [-r readlen] [-s strand]\n"
+"\t           [-v variance] [-x coverage] [-o output] [-z] [--seed seed]\n"
+"\t           [--fragment-format format] [--threads nthread] seq1.fa ...\n"
+"\t" PROGNAME " --pack-reference ref.packed seq1.fa ...\n"
+"\t" PROGNAME " --help\n"
+"\t" PROGNAME " --licence\n"
+"\t" PROGNAME " --version\n"
+PROGNAME " reads from stdin and writes to stdout. Messages and progess\n"
+"indicators are written to stderr.\n"
+"\n"
+"Example:\n"
+"\tcat genome.fa | " PROGNAME " > library.fa\n"
+,fp);
+}
+
+void fprint_licence_LIBOPT( FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+"  " PROGNAME " software for simulating libraries of fragments from genomic sequence\n"
+#include "copyright.inc"
+    ,fp);
+}
+
+void fprint_version_LIBOPT( FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+"  " PROGNAME " software for simulating likelihoods for next-gen sequencing machines\n"
+"Version " PROGVERSION " (compiled: " __DATE__ " using " __VERSION__ ")\n"
+, fp);
+}
+
+
+void fprint_help_LIBOPT( FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+/*
+12345678901234567890123456789012345678901234567890123456789012345678901234567890
+*/
+"\n"
+"-b, --bias bias [default: " QUOTE(DEFAULT_BIAS) "]\n"
+"\tStrand bias for sampling. The probability of sampling a read from the\n"
+"positive strand.\n"
+"\n"
+"-c, --cov cov [default: " QUOTE(DEFAULT_COV) "]\n"
+"\tCoefficient Of Variance (COV) for the read lengths. The COV is the\n"
+"ratio of the variance to the mean^2 and is related to the variance of the\n"
+"log-normal distribution by cov = exp(var)-1. If the variance option is set,\n"
+"it takes presidence.\n"
+"\n"
+"-o, --output format [default: " QUOTE(DEFAULT_OUT) "]\n"
+"Formats supported are \"fasta\" for original headers used by SIMNGS's simlibrary\n"
+"and \"casava\", for a more standard (CASAVA 1.8) format as shown in:\n"
+"http://en.wikipedia.org/wiki/FASTQ_format.\n"
+"\n"
+"-g, --gel_cut lower:upper [default: no cut]\n"
+"\tStrict lower and upper boundaries for fragment length, representing a\n"
+"\"cut\" of a gel. The default is no boundaries.\n"
+"\n"
+"-i, --insert insert_length [default: " QUOTE(DEFAULT_INSERT) "]\n"
+"\tMean length of insert. The mean length of the reads sampled is the\n"
+"insert length plus twice the read length.\n"
+"\n"
+"-m, --multipliers file [default: see text]\n"
+"\tA file containing multiplers, one per line, for the number of\n"
+"fragments to produce for each input sequence. The total number of\n"
+"fragments produced for each sequence is controlled by the --coverage\n"
+"and --nfragments but scaled by the multiplier. If there are multiple\n"
+"input sequences and a multipliers file is not given, or contains\n"
+"insufficient multipliers, then a default multiplier of one is used.\n"
+"\n"
+"--mutate, --mutate=insertion:deletion:mutation [default: 1e-5:1e-6:1e-4]\n"
+"\tSimple model of sequence mutation to reflect sample preparation errors.\n"
+"When the --mutate option is given without an argument, the mutational\n"
+"process is turned off otherwise the default parameters are used.\n"
+"An alternative process of mutation may be specified using the format:\n"
+"\t--mutate=1e-5:1e-6:1e-4\n"
+"\n"
+"-n, --nfragments nfragments [default: from coverage]\n"
+"\tNumber of fragments to produce for library. By default the number of\n"
+"fragments is sufficient for the coverage given. If the number of fragments\n"
+"is set then this option takes priority.\n"
+"\n"
+"-o, --output format [default: fasta]\n"
+"\tThe format in which the fasta name should be formated in the output.\n"
+"Options are:\n"
+"\t'fasta'\tOriginal format for simLibrary."
+"\t'casava'\tA naming format compatible with Casava."
+"\n"
+"-p, --paired [default: true ]\n"
+"\tTurn off paired-end generation. The average fragment length will be\n"
+"shorter by an amount equal to the read length but the main effect of turning\n"
+"off paired-end generation is in the coverage calculations: twice as many\n"
+"fragments will be generated for single-ended runs as paired-end.\n"
+"\n"
+"-r, --readlen read_length [default: " QUOTE(DEFAULT_NCYCLE) "]\n"
+"\tRead length to sample. Affects the total length of fragments produced\n"
+"and the total number of fragments produced via the coverage.\n"
+"\n"
+"-s, --strand strand [default: random]\n"
+"\tStrand from which simulated reads are to come from, relative\n"
+"to current strand. Options are: opposite, random, same.\n"
+"\n"
+"--fragment-format format [default: text]\n"
+"\tFormat in which fragments are written, either \"text\", fasta or fastq\n"
+"as the input, or \"binary\". A binary stream holds each fragment packed two\n"
+"bits per base with its cigar, source coordinates and strand, and is read by\n"
+"simNGS in place of fasta far faster. Qualities are not kept.\n"
+"\n"
+"--seed seed [default: clock]\n"
+"\tSet seed from random number generator.\n"
+"\n"
+"--threads nthread [default: 1]\n"
+"\tSample fragments using nthread threads. Sequences are split into chunks\n"
+"of a few thousand fragments, each with its own stream of random numbers, so\n"
+"the library produced for a seed is the same for any number of threads.\n"
+"\n"
+"-v, --variance variance [default: from COV]\n"
+"\tThe variance of the read length produced. By default, the variance is\n"
+"set using the effective read length and the Coefficient of Variance so the\n"
+"standard deviation is proportional to the mean. Setting the variance takes\n"
+"priority over the COV.\n"
+"\n"
+"-x, --coverage coverage [ default: " QUOTE(DEFAULT_COVERAGE) "]\n"
+"\tAverage coverage of original sequence for simulated by fragments. If\n"
+"the number of fragments to produce is set, it take priority over the coverage.\n"
+"\n"
+"-z, --gzip\n"
+"\tCompress output in BGZF format: gzip compatible and indexable.\n"
+"Compression uses one thread per processor.\n"
+"\n"
+"--pack-reference filename\n"
+"\tPack the input sequences, two bits per base, into filename and exit.\n"
+"A packed reference can be given in place of fasta input and is memory\n"
+"mapped, only the bases of each fragment being unpacked, so many runs can\n"
+"share one copy of a large reference.\n"
+,fp);
+}
+
+static struct option longopts[] = {
+    { "bias",       required_argument, NULL, 'b'},
+    { "cov",        required_argument, NULL, 'c'},
+    { "output",     required_argument, NULL, 'o'},
+    { "gel_cut",    required_argument, NULL, 'g'},
+    { "insert",     required_argument, NULL, 'i'},
+    { "mutate",	    optional_argument, NULL, 3},
+    { "multipliers",required_argument, NULL, 'm'},
+    { "nfragments", required_argument, NULL, 'n'},
+    { "paired",     no_argument,       NULL, 'p'},
+    { "readlen",    required_argument, NULL, 'r'},
+    { "strand",     required_argument, NULL, 's'},
+    { "seed",       required_argument, NULL, 2 },
+    { "variance",   required_argument, NULL, 'v'},
+    { "coverage",   required_argument, NULL, 'x'},
+    { "gzip",       no_argument,       NULL, 'z'},
+    { "pack-reference", required_argument, NULL, 4 },
+    { "threads",    required_argument, NULL, 5 },
+    { "fragment-format", required_argument, NULL, 6 },
+    { "help",       no_argument,       NULL, 'h'},
+    { "licence",    no_argument,       NULL, 0 },
+    { "version",    no_argument,       NULL, 1 },
+    { NULL, 0 , NULL, 0}
+};
+
+LIBOPT new_LIBOPT(void){
+    LIBOPT opt = calloc(1,sizeof(*opt));
+    validate(NULL!=opt,NULL);
+    opt->insertlen = DEFAULT_INSERT;
+    opt->ncycle = DEFAULT_NCYCLE;
+    opt->seed = 0;
+    opt->variance = 0;
+    opt->cov = DEFAULT_COV;
+    opt->coverage = DEFAULT_COVERAGE;
+    opt->output = DEFAULT_OUT;
+    opt->nfragment = 0;
+    opt->paired = true;
+    opt->strand_bias = DEFAULT_BIAS;
+    opt->strand = STRAND_RANDOM;
+    opt->multiplier_fp = NULL;
+    opt->cut_lower = 0; opt->cut_upper = HUGE_VAL;
+    opt->mutate = true;
+    opt->ins=1e-5; opt->del=1e-6; opt->mut=1e-4;
+    opt->gzip = false;
+    opt->pack_fn = NULL;
+    opt->nthread = 1;
+    opt->binary = false;
+    return opt;
+}
+
+void free_LIBOPT( LIBOPT opt){
+    validate(NULL!=opt,);
+    if(NULL!=opt->multiplier_fp){ fclose(opt->multiplier_fp); }
+    safe_free(opt->pack_fn);
+    safe_free(opt);
+}
+
+static real_t parse_real( const CSTRING str){
+    validate(NULL!=str,NAN);
+    real_t x = NAN;
+    sscanf(str,real_format_str,&x);
+    return x;
+}
+
+static unsigned int parse_uint( const CSTRING str){
+    validate(NULL!=str,0);
+    unsigned int n=0;
+    sscanf(str,"%u",&n);
+    return n;
+}
+
+/* Parse simLibrary options. On return, optind is the index of the first
+ * argument that is not an option.
+ */
+LIBOPT parse_LIBOPT(const int argc, char * const argv[] ){
+    int ch,ret;
+    LIBOPT opt = new_LIBOPT();
+    validate(NULL!=opt,NULL);
+    
+    while ((ch = getopt_long(argc, argv, "b:c:o:g:i:m:n:pr:s:v:x:zh", longopts, NULL)) != -1){
+        switch(ch){
+        case 'b':
+            opt->strand_bias = parse_real(optarg);
+            if(!isprob(opt->strand_bias)){ errx(EXIT_FAILURE,"Positive strand bias should be between zero and one, got %f",opt->strand_bias);}
+            break;
+        case 'c':
+            opt->cov = parse_real(optarg);
+            if(opt->cov<0.0){errx(EXIT_FAILURE,"Coefficient Of Variance of for insert size should be non-zero");}
+            break;
+        case 'o':
+                if(!strncasecmp(optarg,"fasta",5)){ opt->output = "fasta"; break;}
+                if(!strncasecmp(optarg,"casava",6)){ opt->output = "casava"; break;}
+                errx(EXIT_FAILURE,"Unrecognised choice \"%s\" for --output format",optarg); break;
+	case 'g':
+	    ret = sscanf(optarg, real_format_str ":" real_format_str ,&opt->cut_lower,&opt->cut_upper);
+	    if(ret<1){
+		    // Try reading just second value
+		    ret = sscanf(optarg, ":" real_format_str,&opt->cut_upper);
+		    if(ret<1){ errx(EXIT_FAILURE,"Failed to read gel cuts");}
+	    }
+	    if(opt->cut_lower<0 || opt->cut_upper<0 || opt->cut_lower>=opt->cut_upper){
+		   errx(EXIT_FAILURE,"Invalid bounds for -gel_cut (%e,%e)",opt->cut_lower,opt->cut_upper);
+	    }
+            break;
+        case 'i':
+            opt->insertlen = parse_uint(optarg);
+            if(0==opt->insertlen){errx(EXIT_FAILURE,"Insert length should be strictly positive");}
+            break;
+        case 'm':
+            opt->multiplier_fp = fopen(optarg,"r");
+            if(NULL==opt->multiplier_fp){
+                warnx("Failed to open multiplier file \"%s\". Using multiplier of one.",optarg);
+            }
+            break;
+	case 3: // Mutation parameters
+	    if(NULL==optarg){ // No optional argument
+                opt->mutate = false;
+                opt->ins = opt->del = opt->mut = 0.0;
+            } // Optional argument present
+            else {
+               ret = sscanf(optarg, real_format_str ":" real_format_str ":" real_format_str,&opt->ins,&opt->del,&opt->mut);
+               if( ret!=3 ){ errx(EXIT_FAILURE,"Insufficient arguments for mutation.");}
+               if(!isprob(opt->ins) || !isprob(opt->del) || !isprob(opt->mut) ){
+                   errx(EXIT_FAILURE,"Mutation parameters not probabilities. Given: ins %f, del %f, mut %f",opt->ins,opt->del,opt->mut);
+               }
+               if(opt->ins+opt->del+opt->mut>1.0){
+                   errx(EXIT_FAILURE,"Mutation parameters sum to greater than one.");
+               }
+               opt->mutate = true;
+            }
+            break;
+        case 'n':
+            opt->nfragment = parse_uint(optarg);
+            break;
+        case 'p':
+            opt->paired = false;
+            break;
+        case 'r':
+            opt->ncycle = parse_uint(optarg);
+            break;
+        case 's':
+            if(!strncasecmp(optarg,"same",4)){ opt->strand = STRAND_SAME; break;}
+            if(!strncasecmp(optarg,"opposite",8)){ opt->strand = STRAND_OPPOSITE; break;}
+            if(!strncasecmp(optarg,"random",6)){ opt->strand = STRAND_RANDOM; break;}
+            errx(EXIT_FAILURE,"Unrecognised choice of strand \"%s\"",optarg); break;
+        case 2: // Change seed
+            opt->seed = parse_uint(optarg);
+            break;
+        case 'v':
+            opt->variance = parse_real(optarg);
+            if(opt->variance<=0.0){errx(EXIT_FAILURE,"Variance of insert size should be non-zero");}
+            break;
+        case 'x':
+            opt->coverage = parse_real(optarg);
+            if(0==opt->coverage){errx(EXIT_FAILURE,"Coverage should be strictly positive");}
+            break;
+        case 'z':
+            opt->gzip = true;
+            break;
+        case 4:
+            opt->pack_fn = copy_CSTRING(optarg);
+            break;
+        case 5:
+            opt->nthread = parse_uint(optarg);
+            if(0==opt->nthread){ errx(EXIT_FAILURE,"Number of threads must be greater than zero."); }
+            break;
+        case 6:
+            if(!strcasecmp(optarg,"text")){ opt->binary = false; break; }
+            if(!strcasecmp(optarg,"binary")){ opt->binary = true; break; }
+            errx(EXIT_FAILURE,"Unrecognised fragment format \"%s\"",optarg); break;
+        case 'h':
+            fprint_usage_LIBOPT(stderr);
+            fprint_help_LIBOPT(stderr);
+            exit(EXIT_SUCCESS);
+        case 0:
+            fprint_licence_LIBOPT(stderr);
+            exit(EXIT_SUCCESS);
+        case 1:
+            fprint_version_LIBOPT(stderr);
+            exit(EXIT_SUCCESS);
+        default:
+            fprint_usage_LIBOPT(stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return opt;
+}
+
+/* Choose a seed, if none given, and derive parameters for sampling from
+ * the options.
+ */
+void finish_LIBOPT( LIBOPT opt){
+    validate(NULL!=opt,);
+    if ( opt->seed==0 ){
+        uint32_t seed = (uint32_t) time(NULL);
+        fprintf(stderr,"Using seed %u\n",seed);
+        opt->seed = seed;
+    }
+
+    // Alter strand_bias if complete bias is required
+    switch(opt->strand){
+    case STRAND_SAME: opt->strand_bias = 1.0; break;
+    case STRAND_OPPOSITE: opt->strand_bias = 0.0; break;
+    default: break;
+    }
+    
+    real_t effectivelen = opt->insertlen + opt->ncycle + ((opt->paired)?opt->ncycle:0);
+    opt->log_sd = (0==opt->variance)?
+        sqrt(log1p(opt->cov)) :
+        sqrt(log1p(opt->variance/(effectivelen*effectivelen)));
+    opt->log_mean = log(effectivelen) - 0.5 * opt->log_sd * opt->log_sd;
+}
+
+real_t rlognorm_with_cuts(real_t logmean, real_t logsd, real_t lower, real_t upper){
+	real_t PhiLogupper = finite(upper)?pnorm(log(upper),logmean,logsd,false,false):1.0;
+	real_t PhiLoglower = (lower>0)?pnorm(log(lower),logmean,logsd,false,false):0.0;
+
+	real_t p = runif()*(PhiLogupper-PhiLoglower) + PhiLoglower;
+
+	return exp(qnorm(p,logmean,logsd,false,false));
+}
+
+
+void free_FRAGSTORE( FRAGSTORE store){
+    if(NULL==store){ return; }
+    if(NULL!=store->edits){ free_EDITLIST(store->edits); }
+    if(NULL!=store->name){ free_OUTBUF(store->name); }
+    safe_free(store->nucs);
+    safe_free(store->frag);
+    free(store);
+}
+
+FRAGSTORE new_FRAGSTORE(void){
+    FRAGSTORE store = calloc(1,sizeof(*store));
+    validate(NULL!=store,NULL);
+    store->edits = new_EDITLIST();
+    store->name = new_OUTBUF(256);
+    if(NULL==store->edits || NULL==store->name){ free_FRAGSTORE(store); return NULL; }
+    return store;
+}
+
+/* Number of fragments to sample from a sequence of given length */
+uint32_t nfragment_sequence( LIBOPT opt, const uint32_t length){
+    // Read multiplier from file, if available
+    double multiplier = 1.;
+    if(NULL!=opt->multiplier_fp){
+        int ret = fscanf(opt->multiplier_fp,"%lf",&multiplier);
+        // Clean-up if file has run out of multipliers.
+        if(1!=ret){
+            warnx("Failed to read multiplier from file. Will use default of 1 from now on"); 
+            fclose(opt->multiplier_fp);
+            opt->multiplier_fp = NULL;
+        }
+        if(multiplier<0.0){
+            warnx("Invalid fragment multiplier %lf. Using 1",multiplier);
+            multiplier = 1.0;
+        }
+    }
+    return multiplier * ( (opt->nfragment)?opt->nfragment:nfragment_from_coverage(length,opt->coverage,opt->ncycle,opt->paired) );
+}
+
+/* Bases of fragment, either in place in seq or unpacked from reference */
+static const NUC * fragment_nucs( FRAGSTORE store, const SEQ seq, const PACKREF ref, const uint32_t idx, const uint32_t loc, const uint32_t len){
+    if(NULL!=seq){ return seq->seq.elt + loc; }
+    if(len>store->cap){
+        NUC * nucs = realloc(store->nucs,len*sizeof(NUC));
+        if(NULL==nucs){ errx(EXIT_FAILURE,"Failed to allocate memory for fragment of length %u",len); }
+        store->nucs = nucs;
+        store->cap = len;
+    }
+    unpack_PACKREF(ref,idx,loc,len,store->nucs);
+    return store->nucs;
+}
+
+/* Qualities of fragment, kept by position and padded if the fragment has
+ * grown by mutation.
+ */
+static void append_fragment_quality( OUTBUF out, const PHREDCHAR * qual, const uint32_t fraglen, const uint32_t len, const bool reverse){
+    char * ptr = reserve_OUTBUF(out,len);
+    for ( uint32_t i=0 ; i<len ; i++){
+        ptr[reverse?(len-i-1):i] = (i<fraglen) ? qual[i] : MIN_PHRED;
+    }
+    out->len += len;
+}
+
+/* Placement of a sampled fragment. Its mutations are in the store */
+typedef struct {
+    uint32_t loc, fraglen;
+    char strand;
+    const NUC * nucs;
+} FRAGMENT;
+
+/* Draw fragment starting in [start,end), from a sequence which is either
+ * seq or sequence idx of a packed reference. Returns false if the fragment
+ * is longer than the sequence.
+ * Fragments that can't start in the range, near the end of the sequence,
+ * are placed uniformly over the whole sequence.
+ */
+static bool draw_fragment( const LIBOPT opt, FRAGSTORE store, const uint32_t length, const SEQ seq, const PACKREF ref, const uint32_t idx, const uint32_t start, const uint32_t end, FRAGMENT * frag){
+    const uint32_t fraglen = (opt->paired)?(uint32_t)(rlognorm_with_cuts(opt->log_mean,opt->log_sd,opt->cut_lower,opt->cut_upper)):opt->ncycle;
+    if(fraglen>length){ return false; }
+    const uint32_t hi = (end<length-fraglen) ? end : length-fraglen;
+    frag->loc = (hi>start) ? (uint32_t)(start + (hi-start)*runif()) : (uint32_t)((length-fraglen)*runif()); // Location is uniform
+    frag->strand = (runif()<opt->strand_bias)?'+':'-';
+    frag->fraglen = fraglen;
+
+    frag->nucs = fragment_nucs(store,seq,ref,idx,frag->loc,fraglen);
+    if(!mutate_EDITLIST(store->edits,frag->nucs,fraglen,opt->ins,opt->del,opt->mut)){
+        errx(EXIT_FAILURE,"Failed to allocate memory for mutations");
+    }
+    return true;
+}
+
+static const NUC comp_nuc[256] = {
+    [0 ... 255] = NUC_AMBIG,
+    [NUC_A] = NUC_T, [NUC_C] = NUC_G, [NUC_G] = NUC_C, [NUC_T] = NUC_A
+};
+
+/* Bases of mutated fragment, on its strand, into nucs */
+static void fragment_bases( const FRAGSTORE store, const FRAGMENT * frag, NUC * nucs){
+    const uint32_t len = store->edits->length;
+    apply_EDITLIST(store->edits,frag->nucs,nucs);
+    if('-'==frag->strand){
+        for ( uint32_t i=0,j=len ; i<j ; i++){
+            j--;
+            const NUC tmp = comp_nuc[(uint8_t)nucs[i]];
+            nucs[i] = comp_nuc[(uint8_t)nucs[j]];
+            nucs[j] = tmp;
+        }
+    }
+}
+
+/* Fragment as binary record, assembled with its cigar on its strand */
+static void append_fragment_binary( FRAGSTORE store, const FRAGMENT * frag, const uint32_t fragidx, OUTBUF out){
+    const uint32_t len = store->edits->length;
+    if(len>store->fragcap){
+        NUC * nucs = realloc(store->frag,len*sizeof(NUC));
+        if(NULL==nucs){ errx(EXIT_FAILURE,"Failed to allocate memory for fragment of length %u",len); }
+        store->frag = nucs;
+        store->fragcap = len;
+    }
+    fragment_bases(store,frag,store->frag);
+    CIGLIST cigar = cigar_EDITLIST(store->edits);
+    const CIGLIST fragcigar = ('-'==frag->strand) ? reverse_cigar_view(cigar) : cigar;
+    append_fragment_FRAGFORMAT(out,fragidx+1,frag->loc,frag->fraglen,frag->strand,store->frag,len,&fragcigar);
+    free_CIGLIST(cigar);
+}
+
+/* Sample fragment number fragidx, starting in [start,end), and write it to
+ * out as text or a binary record. Returns false if the fragment is longer
+ * than the sequence.
+ * The fragment is the reference bases plus a list of mutations, and is
+ * only assembled, on the appropriate strand, when written to output.
+ */
+bool sample_fragment( const LIBOPT opt, FRAGSTORE store, const char * name, const uint32_t length, const SEQ seq, const PACKREF ref, const uint32_t idx, const uint32_t start, const uint32_t end, const uint32_t fragidx, OUTBUF out){
+    FRAGMENT frag;
+    if(!draw_fragment(opt,store,length,seq,ref,idx,start,end,&frag)){ return false; }
+    if(opt->binary){
+        // Sequence is named before its first fragment in out
+        if(!store->named){ append_source_FRAGFORMAT(out,name); }
+        store->named = true;
+        append_fragment_binary(store,&frag,fragidx,out);
+        return true;
+    }
+
+    const bool has_qual = (NULL!=seq && hasQual(seq));
+    append_char_OUTBUF(out,has_qual?'@':'>');
+    append_fragname(out,name,fragidx+1,frag.strand,frag.loc,frag.fraglen,opt->output);
+    append_cstring_OUTBUF(out," \n");
+    append_EDITLIST_OUTBUF(out,frag.nucs,store->edits,frag.strand=='-');
+    append_char_OUTBUF(out,'\n');
+    if(has_qual){
+        append_cstring_OUTBUF(out,"+\n");
+        append_fragment_quality(out,seq->qual.elt+frag.loc,frag.fraglen,store->edits->length,frag.strand=='-');
+        append_char_OUTBUF(out,'\n');
+    }
+    return true;
+}
+
+/* As sample_fragment, but the fragment is returned as the sequence that
+ * would be read back from the text written. Qualities are not kept.
+ */
+static SEQ sample_fragment_SEQ( const LIBOPT opt, FRAGSTORE store, const char * name, const uint32_t length, const SEQ seq, const PACKREF ref, const uint32_t idx, const uint32_t start, const uint32_t end, const uint32_t fragidx){
+    FRAGMENT frag;
+    if(!draw_fragment(opt,store,length,seq,ref,idx,start,end,&frag)){ return NULL; }
+
+    const uint32_t len = store->edits->length;
+    SEQ fragseq = new_SEQ((len>0)?len:1,false);
+    OUTBUF fragname = store->name;
+    clear_OUTBUF(fragname);
+    append_fragname(fragname,name,fragidx+1,frag.strand,frag.loc,frag.fraglen,opt->output);
+    append_OUTBUF(fragname," ",2);    // Name ends with space, as read, and is terminated
+    if(NULL==fragseq || NULL==(fragseq->name=copy_CSTRING(fragname->buf))){
+        errx(EXIT_FAILURE,"Failed to allocate memory for fragment");
+    }
+    fragseq->length = fragseq->seq.nelt = len;
+    fragment_bases(store,&frag,fragseq->seq.elt);
+    fragseq->cigar = pushStart_CIGLIST(fragseq->cigar,'M',len);
+    return fragseq;
+}
+
+/* Each sequence is split into chunks of about CHUNK_FRAGMENTS fragments,
+ * apportioned by length, and chunks are sampled in parallel by a pool of
+ * threads or, with only one thread, in turn on the caller's. Each chunk has
+ * its own random number stream, so output does not depend on the number of
+ * threads or how chunks are scheduled, and chunks are written in order.
+ */
+#define CHUNK_FRAGMENTS 2048
+#define CHUNK_MINLEN 65536
+#define CHUNK_OUTBUF (1<<17)
+
+struct _chunker {
+    LIBOPT opt;
+    enum fragment_output output;
+    CHUNK_WRITE write;
+    void * info;
+    POOL pool;
+    CHUNKJOB direct;    // Job run in place when there is no pool
+    uint64_t nchunk;
+    uint32_t nfragment;
+};
+
+static void free_CHUNKJOB( void * arg){
+    CHUNKJOB job = arg;
+    if(NULL==job){ return; }
+    free_RNGSTREAM(job->rng);
+    free_FRAGSTORE(job->store);
+    if(NULL!=job->out){ free_OUTBUF(job->out); }
+    for ( uint32_t i=0 ; i<job->nfrag ; i++){
+        if(NULL!=job->frag[i]){ free_SEQ(job->frag[i]); }
+    }
+    safe_free(job->frag);
+    free(job);
+}
+
+static void * new_CHUNKJOB( void * info){
+    const CHUNKER chunker = info;
+    CHUNKJOB job = calloc(1,sizeof(*job));
+    validate(NULL!=job,NULL);
+    job->rng = new_RNGSTREAM(chunker->opt->seed);
+    job->store = new_FRAGSTORE();
+    if(FRAGMENT_OUTBUF==chunker->output){ job->out = new_OUTBUF(CHUNK_OUTBUF); }
+    if(NULL==job->rng || NULL==job->store || (FRAGMENT_OUTBUF==chunker->output && NULL==job->out)){
+        free_CHUNKJOB(job);
+        return NULL;
+    }
+    return job;
+}
+
+static void push_fragment( CHUNKJOB job, SEQ fragseq){
+    if(job->nfrag==job->fragcap){
+        const uint32_t cap = (job->fragcap>0) ? 2*job->fragcap : CHUNK_FRAGMENTS;
+        SEQ * frag = realloc(job->frag,cap*sizeof(*frag));
+        if(NULL==frag){ errx(EXIT_FAILURE,"Failed to allocate memory for fragments"); }
+        job->frag = frag;
+        job->fragcap = cap;
+    }
+    job->frag[job->nfrag++] = fragseq;
+}
+
+static void work_CHUNKJOB( void * arg, void * info){
+    CHUNKJOB job = arg;
+    const CHUNKER chunker = info;
+    RNGSTREAM prev = use_RNGSTREAM(job->rng);
+    seek_RNGSTREAM(job->rng,job->chunk,RNG_SUB_LIBRARY);
+    if(NULL!=job->out){ clear_OUTBUF(job->out); }
+    job->store->named = false;
+    job->nskip = 0;
+    for ( uint32_t i=0 ; i<job->nfragment ; i++){
+        if(FRAGMENT_OUTBUF==chunker->output){
+            if(!sample_fragment(chunker->opt,job->store,job->name,job->length,job->seq,job->ref,job->idx,job->start,job->end,job->first+i,job->out)){
+                job->nskip++;
+            }
+        } else {
+            SEQ fragseq = sample_fragment_SEQ(chunker->opt,job->store,job->name,job->length,job->seq,job->ref,job->idx,job->start,job->end,job->first+i);
+            if(NULL==fragseq){ job->nskip++; continue; }
+            push_fragment(job,fragseq);
+        }
+    }
+    use_RNGSTREAM(prev);
+}
+
+static void write_CHUNKJOB( void * arg, void * info){
+    CHUNKJOB job = arg;
+    const CHUNKER chunker = info;
+    chunker->write(job,chunker->info);
+    // Fragments not taken by writer
+    for ( uint32_t i=0 ; i<job->nfrag ; i++){
+        if(NULL!=job->frag[i]){ free_SEQ(job->frag[i]); }
+    }
+    job->nfrag = 0;
+    // Earlier chunks of the sequence have all been written
+    if(job->last && NULL!=job->seq){ free_SEQ(job->seq); }
+    job->seq = NULL;
+}
+
+CHUNKER new_CHUNKER( const LIBOPT opt, const enum fragment_output output, const CHUNK_WRITE write, void * info){
+    validate(NULL!=opt,NULL);
+    validate(NULL!=write,NULL);
+    CHUNKER chunker = calloc(1,sizeof(*chunker));
+    validate(NULL!=chunker,NULL);
+    chunker->opt = opt;
+    chunker->output = output;
+    chunker->write = write;
+    chunker->info = info;
+    if(opt->nthread>1){
+        const POOL_FUNCS funcs = { new_CHUNKJOB, free_CHUNKJOB, work_CHUNKJOB, write_CHUNKJOB };
+        chunker->pool = new_POOL(opt->nthread,4*opt->nthread,funcs,chunker);
+    } else {
+        chunker->direct = new_CHUNKJOB(chunker);
+    }
+    if(NULL==chunker->pool && NULL==chunker->direct){
+        free(chunker);
+        return NULL;
+    }
+    return chunker;
+}
+
+/* Waits for all chunks to be written before freeing */
+void free_CHUNKER( CHUNKER chunker){
+    validate(NULL!=chunker,);
+    if(NULL!=chunker->pool){ free_POOL(chunker->pool); }
+    free_CHUNKJOB(chunker->direct);
+    free(chunker);
+}
+
+/* Split sequence into chunks and submit them for sampling. Takes ownership
+ * of seq.
+ */
+void sample_CHUNKER( CHUNKER chunker, const char * name, const uint32_t length, SEQ seq, const PACKREF ref, const uint32_t idx){
+    validate(NULL!=chunker,);
+    const uint32_t nfragment = nfragment_sequence(chunker->opt,length);
+    if(0==nfragment){
+        if(NULL!=seq){ free_SEQ(seq); }
+        return;
+    }
+    uint32_t nchunk = (nfragment+CHUNK_FRAGMENTS-1)/CHUNK_FRAGMENTS;
+    if(nchunk>length/CHUNK_MINLEN){ nchunk = length/CHUNK_MINLEN; }
+    if(0==nchunk){ nchunk = 1; }
+    uint32_t done = 0;
+    for ( uint32_t c=0 ; c<nchunk ; c++){
+        CHUNKJOB job = (NULL!=chunker->pool) ? next_job_POOL(chunker->pool) : chunker->direct;
+        job->seq = seq;
+        job->ref = ref;
+        job->name = name;
+        job->idx = idx;
+        job->length = length;
+        job->start = (uint32_t)((uint64_t)length*c/nchunk);
+        job->end = (uint32_t)((uint64_t)length*(c+1)/nchunk);
+        const uint32_t upto = (uint32_t)((uint64_t)nfragment*(c+1)/nchunk);
+        job->first = chunker->nfragment + done;
+        job->nfragment = upto - done;
+        done = upto;
+        job->chunk = chunker->nchunk++;
+        job->last = (c+1==nchunk);
+        if(NULL!=chunker->pool){
+            submit_POOL(chunker->pool);
+        } else {
+            work_CHUNKJOB(job,chunker);
+            write_CHUNKJOB(job,chunker);
+        }
+    }
+    chunker->nfragment += nfragment;
+}
+
+/* Pass every sequence of the files, or stdin if there are none, to fn,
+ * which takes ownership of it. Sequences of packed references are passed
+ * as the reference and index, seq being NULL; fragments may be sampled
+ * from them until they are freed, so the references are returned in refs
+ * and the number of them returned.
+ */
+uint32_t sample_files( int nfile, char * files[], LIBSAMPLE fn, void * info, PACKREF ** refs){
+    validate(NULL!=fn,0);
+    validate(NULL!=refs,0);
+    uint32_t nref = 0;
+    *refs = NULL;
+    FILE * fp = stdin;
+    SEQ seq = NULL;
+    do { // Iterate through filenames
+        if(nfile>0){
+            fp = fopen(files[0],"r");
+            if(NULL==fp){
+                warnx("Failed to open file \"%s\" for input",files[0]);
+            }
+        }
+        if(NULL!=fp && is_PACKREF(fp)){
+            PACKREF ref = new_PACKREF(fp);
+            if(NULL==ref){ errx(EXIT_FAILURE,"Failed to load packed reference \"%s\"",(nfile>0)?files[0]:"stdin"); }
+            PACKREF * newrefs = realloc(*refs,(nref+1)*sizeof(*newrefs));
+            if(NULL==newrefs){ errx(EXIT_FAILURE,"Failed to allocate memory"); }
+            *refs = newrefs;
+            (*refs)[nref++] = ref;
+            for ( uint32_t i=0 ; i<nseq_PACKREF(ref) ; i++){
+                fn(info,name_PACKREF(ref,i),length_PACKREF(ref,i),NULL,ref,i);
+            }
+        } else {
+            SEQREADER reader = (NULL!=fp) ? new_SEQREADER(fp,nprocessor()) : NULL;
+            while (NULL!=reader && (seq=sequence_from_SEQREADER(reader))!=NULL){
+                fn(info,seq->name,seq->length,seq,NULL,0);
+            }
+            if(NULL!=reader){ free_SEQREADER(reader); }
+        }
+        if(NULL!=fp){ fclose(fp); }
+        nfile--;
+        files++;
+    } while(nfile>0);
+    return nref;
+}
+
+/* Fragments sampled on a separate thread and passed through a queue. The
+ * writer adds all fragments of a chunk at once and the reader takes all
+ * those queued, so threads rarely need to wake each other.
+ */
+#define LIBSOURCE_QUEUE 8192
+
+struct _libsource {
+    LIBOPT opt;
+    int nfile;
+    char ** files;
+    SEQ * queue;
+    uint32_t nqueue;
+    SEQ * taken;                // Fragments taken from queue by reader
+    uint32_t ntaken, next;
+    bool finished, closed;
+    uint32_t skipped;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_put, cond_get;
+    pthread_t producer;
+};
+
+static void sample_LIBSOURCE( void * info, const char * name, const uint32_t length, SEQ seq, const PACKREF ref, const uint32_t idx){
+    sample_CHUNKER(info,name,length,seq,ref,idx);
+}
+
+static void write_LIBSOURCE( const CHUNKJOB job, void * info){
+    LIBSOURCE src = info;
+    pthread_mutex_lock(&src->lock);
+    if(job->nskip>0 && 0==src->skipped){
+        warnx("Length of fragment (2*readlen+insert) is greater than sequence length. Skipping");
+    }
+    src->skipped += job->nskip;
+    uint32_t i = 0;
+    while( i<job->nfrag && !src->closed ){
+        while( src->nqueue==LIBSOURCE_QUEUE && !src->closed ){
+            pthread_cond_wait(&src->cond_put,&src->lock);
+        }
+        for ( ; i<job->nfrag && src->nqueue<LIBSOURCE_QUEUE ; i++){
+            src->queue[src->nqueue++] = job->frag[i];
+            job->frag[i] = NULL;
+        }
+        pthread_cond_signal(&src->cond_get);
+    }
+    pthread_mutex_unlock(&src->lock);
+}
+
+static void * producer_thread( void * arg){
+    LIBSOURCE src = arg;
+    CHUNKER chunker = new_CHUNKER(src->opt,FRAGMENT_SEQ,write_LIBSOURCE,src);
+    if(NULL==chunker){ errx(EXIT_FAILURE,"Failed to create pool of %u threads",src->opt->nthread); }
+    PACKREF * refs = NULL;
+    const uint32_t nref = sample_files(src->nfile,src->files,sample_LIBSOURCE,chunker,&refs);
+    free_CHUNKER(chunker);
+    for ( uint32_t i=0 ; i<nref ; i++){ free_PACKREF(refs[i]); }
+    safe_free(refs);
+
+    pthread_mutex_lock(&src->lock);
+    src->finished = true;
+    pthread_cond_broadcast(&src->cond_get);
+    pthread_mutex_unlock(&src->lock);
+    return NULL;
+}
+
+/* Start sampling fragments from files, or stdin if there are none, using
+ * options that have been finished by finish_LIBOPT.
+ */
+LIBSOURCE new_LIBSOURCE( const LIBOPT opt, const int nfile, char * files[]){
+    validate(NULL!=opt,NULL);
+    LIBSOURCE src = calloc(1,sizeof(*src));
+    validate(NULL!=src,NULL);
+    src->opt = opt;
+    src->nfile = nfile;
+    src->files = files;
+    src->queue = calloc(LIBSOURCE_QUEUE,sizeof(*src->queue));
+    src->taken = calloc(LIBSOURCE_QUEUE,sizeof(*src->taken));
+    if(NULL==src->queue || NULL==src->taken){
+        safe_free(src->queue);
+        safe_free(src->taken);
+        free(src);
+        return NULL;
+    }
+    pthread_mutex_init(&src->lock,NULL);
+    pthread_cond_init(&src->cond_put,NULL);
+    pthread_cond_init(&src->cond_get,NULL);
+    if(0!=pthread_create(&src->producer,NULL,producer_thread,src)){
+        errx(EXIT_FAILURE,"Failed to create thread for sampling library");
+    }
+    return src;
+}
+
+/* Next fragment sampled, in order, or NULL once all have been returned */
+SEQ next_LIBSOURCE( LIBSOURCE src){
+    validate(NULL!=src,NULL);
+    if(src->next<src->ntaken){ return src->taken[src->next++]; }
+
+    pthread_mutex_lock(&src->lock);
+    while( 0==src->nqueue && !src->finished ){
+        pthread_cond_wait(&src->cond_get,&src->lock);
+    }
+    // Swap queue with empty array of taken fragments
+    SEQ * queue = src->queue;
+    src->queue = src->taken;
+    src->taken = queue;
+    src->ntaken = src->nqueue;
+    src->nqueue = 0;
+    pthread_cond_signal(&src->cond_put);
+    pthread_mutex_unlock(&src->lock);
+
+    src->next = 0;
+    return (src->ntaken>0) ? src->taken[src->next++] : NULL;
+}
+
+/* Fragments not yet returned are discarded */
+void free_LIBSOURCE( LIBSOURCE src){
+    validate(NULL!=src,);
+    pthread_mutex_lock(&src->lock);
+    src->closed = true;
+    pthread_cond_broadcast(&src->cond_put);
+    pthread_mutex_unlock(&src->lock);
+    pthread_join(src->producer,NULL);
+
+    for ( uint32_t i=src->next ; i<src->ntaken ; i++){ free_SEQ(src->taken[i]); }
+    for ( uint32_t i=0 ; i<src->nqueue ; i++){ free_SEQ(src->queue[i]); }
+    if(src->skipped>0){
+        fprintf(stderr,"Skipped %" SCNu32 " fragments.\n",src->skipped);
+    }
+    pthread_cond_destroy(&src->cond_get);
+    pthread_cond_destroy(&src->cond_put);
+    pthread_mutex_destroy(&src->lock);
+    free(src->queue);
+    free(src->taken);
+    free(src);
+}
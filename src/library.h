@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2010 by Tim Massingham, European Bioinformatics Institute
+ *  tim.massingham@ebi.ac.uk
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _LIBRARY_H
+#define _LIBRARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "utility.h"
+#include "sequence.h"
+#include "packref.h"
+#include "outbuf.h"
+#include "random.h"
+#include "fragformat.h"
+
+/* Sampling of a library of fragments from sequence, shared by simLibrary
+ * and the in-process library of simNGS.
+ */
+enum strand_opt { STRAND_RANDOM, STRAND_SAME, STRAND_OPPOSITE };
+
+#define DEFAULT_COV         0.055
+#define DEFAULT_OUT         "fasta"
+#define DEFAULT_INSERT      400
+#define DEFAULT_NCYCLE      45
+#define DEFAULT_COVERAGE    2.0
+#define DEFAULT_BIAS        0.5
+
+typedef struct {
+    uint32_t insertlen, ncycle, nfragment;
+    bool paired;
+    uint32_t seed;
+    real_t variance,cov,strand_bias,coverage;
+    CSTRING output;
+    enum strand_opt strand;
+    FILE * multiplier_fp;
+    real_t cut_lower, cut_upper;
+    bool mutate;
+    real_t ins,del,mut;
+    bool gzip;
+    CSTRING pack_fn;
+    uint32_t nthread;
+    bool binary;                // Fragments written as binary stream
+    real_t log_mean, log_sd;    // Set by finish_LIBOPT
+} * LIBOPT;
+
+LIBOPT new_LIBOPT(void);
+void free_LIBOPT( LIBOPT opt);
+LIBOPT parse_LIBOPT( const int argc, char * const argv[]);
+void finish_LIBOPT( LIBOPT opt);
+void fprint_usage_LIBOPT( FILE * fp);
+void fprint_help_LIBOPT( FILE * fp);
+void fprint_licence_LIBOPT( FILE * fp);
+void fprint_version_LIBOPT( FILE * fp);
+
+uint32_t nfragment_from_coverage(const uint32_t genlen, const real_t coverage, const uint32_t readlen, const bool paired);
+uint32_t nfragment_sequence( LIBOPT opt, const uint32_t length);
+real_t rlognorm_with_cuts(real_t logmean, real_t logsd, real_t lower, real_t upper);
+
+/* Storage reused between fragments sampled by one thread */
+typedef struct {
+    EDITLIST edits;
+    NUC * nucs;         // Fragment unpacked from packed reference
+    uint32_t cap;
+    OUTBUF name;        // Name of fragment returned as sequence
+    NUC * frag;         // Fragment assembled for binary output
+    uint32_t fragcap;
+    bool named;         // Binary output has named current sequence
+} * FRAGSTORE;
+
+FRAGSTORE new_FRAGSTORE(void);
+void free_FRAGSTORE( FRAGSTORE store);
+bool sample_fragment( const LIBOPT opt, FRAGSTORE store, const char * name, const uint32_t length, const SEQ seq, const PACKREF ref, const uint32_t idx, const uint32_t start, const uint32_t end, const uint32_t fragidx, OUTBUF out);
+
+/* Sequences, or sequence idx of a packed reference, to sample from */
+typedef void (*LIBSAMPLE)( void * info, const char * name, const uint32_t length, SEQ seq, const PACKREF ref, const uint32_t idx);
+uint32_t sample_files( int nfile, char * files[], LIBSAMPLE fn, void * info, PACKREF ** refs);
+
+/* Sequences split into chunks sampled by a pool of threads, each chunk
+ * with its own random number stream. Fragments of a chunk are either
+ * written to out, as by sample_fragment, or returned as sequences in frag;
+ * the write function is called for chunks in order and may take sequences
+ * from frag, setting their entries to NULL.
+ */
+enum fragment_output { FRAGMENT_OUTBUF, FRAGMENT_SEQ };
+
+typedef struct {
+    SEQ seq;                    // Owned by last chunk of sequence
+    PACKREF ref;
+    const char * name;
+    uint32_t idx, length;
+    uint32_t start, end;        // Range of fragment starts
+    uint32_t first, nfragment;  // Index of first fragment and number
+    uint64_t chunk;             // Index of chunk, for random numbers
+    bool last;
+    uint32_t nskip;
+    RNGSTREAM rng;
+    FRAGSTORE store;
+    OUTBUF out;
+    SEQ * frag;
+    uint32_t nfrag, fragcap;
+} * CHUNKJOB;
+
+typedef void (*CHUNK_WRITE)( const CHUNKJOB job, void * info);
+typedef struct _chunker * CHUNKER;
+
+CHUNKER new_CHUNKER( const LIBOPT opt, const enum fragment_output output, const CHUNK_WRITE write, void * info);
+void sample_CHUNKER( CHUNKER chunker, const char * name, const uint32_t length, SEQ seq, const PACKREF ref, const uint32_t idx);
+void free_CHUNKER( CHUNKER chunker);
+
+/* Fragments sampled by chunks in the background, returned in order */
+typedef struct _libsource * LIBSOURCE;
+
+LIBSOURCE new_LIBSOURCE( const LIBOPT opt, const int nfile, char * files[]);
+SEQ next_LIBSOURCE( LIBSOURCE src);
+void free_LIBSOURCE( LIBSOURCE src);
+
+#endif
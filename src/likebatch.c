@@ -0,0 +1,433 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "likebatch.h"
+
+#if !defined(USEFLOAT) && defined(__GNUC__) && defined(__x86_64__)
+    #define LIKEBATCH_HAVE_AVX2
+    #include <immintrin.h>
+#endif
+
+// Parameters of log-normal distribution of squared radius, as likelihood_cycle_intensities
+#define LOGSD 1.088
+
+LIKEBATCH new_LIKEBATCH( const uint32_t capacity, const uint32_t ncycle){
+    validate(capacity>0,NULL);
+    validate(ncycle>0,NULL);
+    LIKEBATCH batch = calloc(1,sizeof(*batch));
+    validate(NULL!=batch,NULL);
+    batch->capacity = capacity;
+    batch->stride = LIKEBATCH_LANES * ((capacity+LIKEBATCH_LANES-1)/LIKEBATCH_LANES);
+    batch->ncycle = ncycle;
+    const size_t nelt = (size_t)batch->stride * ncycle * NBASE;
+    // Aligned for vector loads
+    if( 0!=posix_memalign((void **)&batch->ints,32,nelt*sizeof(real_t)) ){ batch->ints = NULL; goto cleanup; }
+    if( 0!=posix_memalign((void **)&batch->like,32,nelt*sizeof(real_t)) ){ batch->like = NULL; goto cleanup; }
+    if( 0!=posix_memalign((void **)&batch->lambda,32,batch->stride*sizeof(real_t)) ){ batch->lambda = NULL; goto cleanup; }
+    batch->calls = calloc((size_t)batch->stride*ncycle,sizeof(NUC));
+    if(NULL==batch->calls){ goto cleanup; }
+    // Padding reads have zero intensity and unit brightness, so the quadratic
+    // form is positive and all calculations finite.
+    memset(batch->ints,0,nelt*sizeof(real_t));
+    for ( uint32_t r=0 ; r<batch->stride ; r++){
+        batch->lambda[r] = 1.0;
+    }
+    return batch;
+
+cleanup:
+    free_LIKEBATCH(batch);
+    return NULL;
+}
+
+void free_LIKEBATCH( LIKEBATCH batch){
+    if(NULL==batch){ return; }
+    safe_free(batch->ints);
+    safe_free(batch->like);
+    safe_free(batch->lambda);
+    safe_free(batch->calls);
+    free(batch);
+}
+
+void clear_LIKEBATCH( LIKEBATCH batch){
+    validate(NULL!=batch,);
+    batch->nread = 0;
+}
+
+/* Add intensities of read to batch, returning false if the batch is full */
+bool add_LIKEBATCH( LIKEBATCH batch, const MAT ints, const real_t lambda){
+    validate(NULL!=batch,false);
+    validate(NULL!=ints,false);
+    validate(NBASE*batch->ncycle==ints->nrow*ints->ncol,false);
+    if(batch->nread==batch->capacity){ return false; }
+    const uint32_t r = batch->nread;
+    const uint32_t nelt = NBASE*batch->ncycle;
+    for ( uint32_t i=0 ; i<nelt ; i++){
+        batch->ints[(size_t)i*batch->stride+r] = ints->x[i];
+    }
+    batch->lambda[r] = lambda;
+    batch->nread++;
+    return true;
+}
+
+MAT loglike_LIKEBATCH( const LIKEBATCH batch, const uint32_t r, MAT like){
+    validate(NULL!=batch,NULL);
+    validate(r<batch->nread,NULL);
+    if(NULL==like){
+        like = new_MAT(NBASE,batch->ncycle);
+        validate(NULL!=like,NULL);
+    }
+    const uint32_t nelt = NBASE*batch->ncycle;
+    for ( uint32_t i=0 ; i<nelt ; i++){
+        like->x[i] = batch->like[(size_t)i*batch->stride+r];
+    }
+    return like;
+}
+
+ARRAY(NUC) calls_LIKEBATCH( const LIKEBATCH batch, const uint32_t r, ARRAY(NUC) calls){
+    validate(NULL!=batch,null_ARRAY(NUC));
+    validate(r<batch->nread,null_ARRAY(NUC));
+    if(NULL==calls.elt){
+        calls = new_ARRAY(NUC)(batch->ncycle);
+        validate(NULL!=calls.elt,null_ARRAY(NUC));
+    }
+    for ( uint32_t cy=0 ; cy<batch->ncycle ; cy++){
+        calls.elt[cy] = batch->calls[(size_t)cy*batch->stride+r];
+    }
+    return calls;
+}
+
+
+/* Scalar engine. Arithmetic is in the same order as the precomputed path of
+ * likelihood_cycle_intensities, so results are identical.
+ */
+static void likelihood_scalar( LIKEBATCH batch, const real_t sdfact, const real_t mu, const MAT prec){
+    const real_t logmean = log(NBASE)-LOGSD*LOGSD*0.5;
+    const real_t isd2 = 1.0/(sdfact*sdfact);
+    const real_t log_mu = (mu>0.0) ? log(mu) : 0.0;
+    const uint32_t stride = batch->stride;
+    for ( uint32_t cy=0 ; cy<batch->ncycle ; cy++){
+        const real_t * p = prec->x + cy*NBASE*NBASE;
+        const real_t * x = batch->ints + (size_t)cy*NBASE*stride;
+        real_t * like = batch->like + (size_t)cy*NBASE*stride;
+        NUC * calls = batch->calls + (size_t)cy*stride;
+        for ( uint32_t r=0 ; r<batch->nread ; r++){
+            const real_t lambda = batch->lambda[r];
+            real_t px[NBASE];
+            real_t xpx = 0.;
+            for ( uint32_t j=0 ; j<NBASE ; j++){
+                real_t s = 0.;
+                for ( uint32_t k=0 ; k<NBASE ; k++){
+                    s += p[j*NBASE+k] * x[k*stride+r];
+                }
+                px[j] = s;
+                xpx += s * x[j*stride+r];
+            }
+            NUC call = NUC_A;
+            real_t lmin = HUGE_VAL;
+            for ( uint32_t j=0 ; j<NBASE ; j++){
+                real_t t = (xpx - 2.0*lambda*px[j] + lambda*lambda*p[j*NBASE+j]) * isd2;
+                if(t<DBL_MIN){ t = DBL_MIN; }
+                const real_t del = (log(t)-logmean)/LOGSD;
+                real_t l = del*del/2.0 + 2.0 * log(t);
+                if(mu>0.0){ l = -log_mu - log1p( exp(-l-log_mu) ); }
+                like[j*stride+r] = l;
+                if(l<lmin){ lmin = l; call = j; }
+            }
+            calls[r] = call;
+        }
+    }
+}
+
+
+#ifdef LIKEBATCH_HAVE_AVX2
+/* Vector log and exp for four doubles, after the Cephes library.
+ * Arguments of log must be positive and normal; arguments of exp are
+ * clamped to the range where the result is a normal number.
+ */
+__attribute__((target("avx2")))
+static inline __m256d log_pd( __m256d x){
+    const __m256d one = _mm256_set1_pd(1.0);
+    // Split x = m 2^e with m in [0.5,1)
+    const __m256i xi = _mm256_castpd_si256(x);
+    const __m256i ebits = _mm256_srli_epi64(xi,52);
+    const __m256d magic = _mm256_set1_pd(4503599627370496.0);  // 2^52
+    __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(ebits,_mm256_castpd_si256(magic))),magic);
+    e = _mm256_sub_pd(e,_mm256_set1_pd(1022.0));
+    __m256d m = _mm256_and_pd(x,_mm256_castsi256_pd(_mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)));
+    m = _mm256_or_pd(m,_mm256_set1_pd(0.5));
+    // Reduce to [sqrt(0.5),sqrt(2)) - 1
+    const __m256d small = _mm256_cmp_pd(m,_mm256_set1_pd(0.70710678118654752440),_CMP_LT_OQ);
+    e = _mm256_sub_pd(e,_mm256_and_pd(small,one));
+    x = _mm256_add_pd(_mm256_sub_pd(m,one),_mm256_and_pd(small,m));
+
+    const __m256d z = _mm256_mul_pd(x,x);
+    __m256d p = _mm256_set1_pd(1.01875663804580931796E-4);
+    p = _mm256_add_pd(_mm256_mul_pd(p,x),_mm256_set1_pd(4.97494994976747001425E-1));
+    p = _mm256_add_pd(_mm256_mul_pd(p,x),_mm256_set1_pd(4.70579119878881725854E0));
+    p = _mm256_add_pd(_mm256_mul_pd(p,x),_mm256_set1_pd(1.44989225341610930846E1));
+    p = _mm256_add_pd(_mm256_mul_pd(p,x),_mm256_set1_pd(1.79368678507819816313E1));
+    p = _mm256_add_pd(_mm256_mul_pd(p,x),_mm256_set1_pd(7.70838733755885391666E0));
+    __m256d q = _mm256_add_pd(x,_mm256_set1_pd(1.12873587189167450590E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q,x),_mm256_set1_pd(4.52279145837532221105E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q,x),_mm256_set1_pd(8.29875266912776603211E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q,x),_mm256_set1_pd(7.11544750618563894466E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q,x),_mm256_set1_pd(2.31251620126765340583E1));
+
+    __m256d y = _mm256_mul_pd(x,_mm256_div_pd(_mm256_mul_pd(z,p),q));
+    y = _mm256_sub_pd(y,_mm256_mul_pd(e,_mm256_set1_pd(2.121944400546905827679e-4)));
+    y = _mm256_sub_pd(y,_mm256_mul_pd(z,_mm256_set1_pd(0.5)));
+    return _mm256_add_pd(_mm256_add_pd(x,y),_mm256_mul_pd(e,_mm256_set1_pd(0.693359375)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256d exp_pd( __m256d x){
+    x = _mm256_max_pd(x,_mm256_set1_pd(-708.0));
+    x = _mm256_min_pd(x,_mm256_set1_pd(709.0));
+    // x = g + n log(2)
+    const __m256d n = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(x,_mm256_set1_pd(1.4426950408889634073599)),_mm256_set1_pd(0.5)));
+    x = _mm256_sub_pd(x,_mm256_mul_pd(n,_mm256_set1_pd(6.93145751953125E-1)));
+    x = _mm256_sub_pd(x,_mm256_mul_pd(n,_mm256_set1_pd(1.42860682030941723212E-6)));
+
+    const __m256d xx = _mm256_mul_pd(x,x);
+    __m256d p = _mm256_set1_pd(1.26177193074810590878E-4);
+    p = _mm256_add_pd(_mm256_mul_pd(p,xx),_mm256_set1_pd(3.02994407707441961300E-2));
+    p = _mm256_add_pd(_mm256_mul_pd(p,xx),_mm256_set1_pd(9.99999999999999999910E-1));
+    p = _mm256_mul_pd(p,x);
+    __m256d q = _mm256_set1_pd(3.00198505138664455042E-6);
+    q = _mm256_add_pd(_mm256_mul_pd(q,xx),_mm256_set1_pd(2.52448340349684104192E-3));
+    q = _mm256_add_pd(_mm256_mul_pd(q,xx),_mm256_set1_pd(2.27265548208155028766E-1));
+    q = _mm256_add_pd(_mm256_mul_pd(q,xx),_mm256_set1_pd(2.00000000000000000009E0));
+    x = _mm256_div_pd(p,_mm256_sub_pd(q,p));
+    x = _mm256_add_pd(_mm256_set1_pd(1.0),_mm256_add_pd(x,x));
+
+    // Multiply by 2^n
+    __m256i ni = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    ni = _mm256_slli_epi64(_mm256_add_epi64(ni,_mm256_set1_epi64x(1023)),52);
+    return _mm256_mul_pd(x,_mm256_castsi256_pd(ni));
+}
+
+/* log(1+y) for y>=0, using log(u) y / (u-1) where u = 1+y to recover the
+ * rounding error in u.
+ */
+__attribute__((target("avx2")))
+static inline __m256d log1p_pd( const __m256d y){
+    const __m256d u = _mm256_add_pd(_mm256_set1_pd(1.0),y);
+    const __m256d um1 = _mm256_sub_pd(u,_mm256_set1_pd(1.0));
+    const __m256d r = _mm256_div_pd(_mm256_mul_pd(log_pd(u),y),um1);
+    const __m256d exact = _mm256_cmp_pd(um1,_mm256_setzero_pd(),_CMP_EQ_OQ);
+    return _mm256_blendv_pd(r,y,exact);
+}
+
+__attribute__((target("avx2")))
+static void likelihood_avx2( LIKEBATCH batch, const real_t sdfact, const real_t mu, const MAT prec){
+    const __m256d logmean = _mm256_set1_pd(log(NBASE)-LOGSD*LOGSD*0.5);
+    const __m256d ilogsd = _mm256_set1_pd(1.0/LOGSD);
+    const __m256d isd2 = _mm256_set1_pd(1.0/(sdfact*sdfact));
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d tmin = _mm256_set1_pd(DBL_MIN);
+    const __m256d log_mu = _mm256_set1_pd((mu>0.0)?log(mu):0.0);
+    const uint32_t stride = batch->stride;
+    const uint32_t nr = LIKEBATCH_LANES * ((batch->nread+LIKEBATCH_LANES-1)/LIKEBATCH_LANES);
+
+    for ( uint32_t cy=0 ; cy<batch->ncycle ; cy++){
+        __m256d p[NBASE*NBASE];
+        for ( uint32_t i=0 ; i<NBASE*NBASE ; i++){
+            p[i] = _mm256_set1_pd(prec->x[cy*NBASE*NBASE+i]);
+        }
+        const real_t * xc = batch->ints + (size_t)cy*NBASE*stride;
+        real_t * likec = batch->like + (size_t)cy*NBASE*stride;
+        NUC * calls = batch->calls + (size_t)cy*stride;
+        for ( uint32_t r=0 ; r<nr ; r+=LIKEBATCH_LANES){
+            const __m256d lambda = _mm256_load_pd(batch->lambda+r);
+            const __m256d lambda2 = _mm256_mul_pd(lambda,lambda);
+            __m256d x[NBASE];
+            for ( uint32_t k=0 ; k<NBASE ; k++){
+                x[k] = _mm256_load_pd(xc+k*stride+r);
+            }
+            __m256d px[NBASE];
+            __m256d xpx = _mm256_setzero_pd();
+            for ( uint32_t j=0 ; j<NBASE ; j++){
+                __m256d s = _mm256_setzero_pd();
+                for ( uint32_t k=0 ; k<NBASE ; k++){
+                    s = _mm256_add_pd(s,_mm256_mul_pd(p[j*NBASE+k],x[k]));
+                }
+                px[j] = s;
+                xpx = _mm256_add_pd(xpx,_mm256_mul_pd(s,x[j]));
+            }
+
+            __m256d lmin = _mm256_set1_pd(HUGE_VAL);
+            __m256d call = _mm256_setzero_pd();
+            for ( uint32_t j=0 ; j<NBASE ; j++){
+                __m256d t = _mm256_sub_pd(xpx,_mm256_mul_pd(_mm256_mul_pd(two,lambda),px[j]));
+                t = _mm256_add_pd(t,_mm256_mul_pd(lambda2,p[j*NBASE+j]));
+                t = _mm256_max_pd(_mm256_mul_pd(t,isd2),tmin);
+                const __m256d logt = log_pd(t);
+                const __m256d del = _mm256_mul_pd(_mm256_sub_pd(logt,logmean),ilogsd);
+                __m256d l = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(del,del),half),_mm256_mul_pd(two,logt));
+                if(mu>0.0){
+                    const __m256d e = exp_pd(_mm256_sub_pd(_mm256_setzero_pd(),_mm256_add_pd(l,log_mu)));
+                    l = _mm256_sub_pd(_mm256_sub_pd(_mm256_setzero_pd(),log_mu),log1p_pd(e));
+                }
+                _mm256_store_pd(likec+j*stride+r,l);
+                const __m256d better = _mm256_cmp_pd(l,lmin,_CMP_LT_OQ);
+                lmin = _mm256_blendv_pd(lmin,l,better);
+                call = _mm256_blendv_pd(call,_mm256_set1_pd((double)j),better);
+            }
+            double c[LIKEBATCH_LANES];
+            _mm256_storeu_pd(c,call);
+            for ( uint32_t i=0 ; i<LIKEBATCH_LANES ; i++){
+                calls[r+i] = (NUC)c[i];
+            }
+        }
+    }
+}
+#endif
+
+bool has_avx2_LIKEBATCH(void){
+#ifdef LIKEBATCH_HAVE_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+/* Likelihoods and calls for every read in batch. prec holds the per-cycle
+ * precision matrices of the model (MODEL prec1 or prec2). Returns the engine
+ * actually used, AUTO selecting AVX2 where the processor supports it.
+ */
+enum likebatch_engine likelihood_LIKEBATCH( LIKEBATCH batch, const real_t sdfact, const real_t mu, const MAT prec, enum likebatch_engine engine){
+    validate(NULL!=batch,LIKEBATCH_AUTO);
+    validate(NULL!=prec,LIKEBATCH_AUTO);
+    validate(prec->ncol>=batch->ncycle,LIKEBATCH_AUTO);
+    if(LIKEBATCH_SCALAR!=engine){
+        engine = has_avx2_LIKEBATCH() ? LIKEBATCH_AVX2 : LIKEBATCH_SCALAR;
+    }
+#ifdef LIKEBATCH_HAVE_AVX2
+    if(LIKEBATCH_AVX2==engine){
+        likelihood_avx2(batch,sdfact,mu,prec);
+        return engine;
+    }
+#endif
+    likelihood_scalar(batch,sdfact,mu,prec);
+    return LIKEBATCH_SCALAR;
+}
+
+
+#ifdef BENCH
+#include <time.h>
+#include "random.h"
+#include "intensities.h"
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+int main ( int argc, char * argv[] ){
+    if(argc<2){
+        fputs("Usage: bench-likebatch runfile [nread] [batchsize]\n",stderr);
+        return EXIT_FAILURE;
+    }
+    const uint32_t nread = (argc>2) ? strtoul(argv[2],NULL,10) : 20000;
+    const uint32_t bsize = (argc>3) ? strtoul(argv[3],NULL,10) : 256;
+    const real_t mu = 1e-5;
+    MODEL model = new_MODEL_from_file(argv[1]);
+    if(NULL==model){ errx(EXIT_FAILURE,"Failed to read runfile %s",argv[1]); }
+    const uint32_t ncycle = model->ncycle;
+    init_gen_rand(1);
+
+    // Simulated reads
+    MAT * ints = calloc(nread,sizeof(*ints));
+    real_t * lambda = calloc(nread,sizeof(*lambda));
+    ARRAY(NUC) seq = new_ARRAY(NUC)(ncycle);
+    for ( uint32_t i=0 ; i<nread ; i++){
+        for ( uint32_t cy=0 ; cy<ncycle ; cy++){ seq.elt[cy] = random_NUC(); }
+        lambda[i] = qdistribution(runif(),model->dist1,false,false);
+        ints[i] = generate_pure_intensities(1.0,lambda[i],seq,null_ARRAY(NUC),ncycle,model->factors1->chol,0.0,NULL,NULL,NULL);
+    }
+    free_ARRAY(NUC)(seq);
+
+    // Current per-read path
+    MAT * ref = calloc(nread,sizeof(*ref));
+    ARRAY(NUC) * refcalls = calloc(nread,sizeof(*refcalls));
+    double t0 = now();
+    for ( uint32_t i=0 ; i<nread ; i++){
+        ref[i] = likelihood_cycle_intensities(1.0,mu,lambda[i],ints[i],model->factors1->invchol,model->prec1,NULL);
+        refcalls[i] = call_by_maximum_likelihood(ref[i],null_ARRAY(NUC));
+    }
+    const double tref = now()-t0;
+    fprintf(stdout,"per-read  %12.0f reads/sec\n",nread/tref);
+
+    LIKEBATCH batch = new_LIKEBATCH(bsize,ncycle);
+    MAT like = NULL;
+    ARRAY(NUC) calls = null_ARRAY(NUC);
+    const enum likebatch_engine engines[] = { LIKEBATCH_SCALAR, LIKEBATCH_AVX2 };
+    const char * engine_str[] = { "auto", "scalar", "avx2" };
+    for ( int e=0 ; e<2 ; e++){
+        if(LIKEBATCH_AVX2==engines[e] && !has_avx2_LIKEBATCH()){
+            fputs("avx2      not supported by processor\n",stdout);
+            continue;
+        }
+        double tbatch = 0.0, maxdiff = 0.0;
+        uint32_t ndiffcall = 0;
+        for ( uint32_t i=0 ; i<nread ; i+=bsize){
+            const uint32_t n = (nread-i<bsize) ? (nread-i) : bsize;
+            // Transposing reads into the batch is part of the cost
+            t0 = now();
+            clear_LIKEBATCH(batch);
+            for ( uint32_t j=0 ; j<n ; j++){ add_LIKEBATCH(batch,ints[i+j],lambda[i+j]); }
+            likelihood_LIKEBATCH(batch,1.0,mu,model->prec1,engines[e]);
+            tbatch += now()-t0;
+            // Check against per-read path
+            for ( uint32_t j=0 ; j<n ; j++){
+                like = loglike_LIKEBATCH(batch,j,like);
+                calls = calls_LIKEBATCH(batch,j,calls);
+                for ( uint32_t k=0 ; k<NBASE*ncycle ; k++){
+                    const double d = fabs(like->x[k]-ref[i+j]->x[k]) / (1.0+fabs(ref[i+j]->x[k]));
+                    if(d>maxdiff){ maxdiff = d; }
+                }
+                for ( uint32_t cy=0 ; cy<ncycle ; cy++){
+                    if(calls.elt[cy]!=refcalls[i+j].elt[cy]){ ndiffcall++; }
+                }
+            }
+        }
+        fprintf(stdout,"%-8s  %12.0f reads/sec  (x%.2f)  max rel diff %.3e  differing calls %u\n",
+            engine_str[engines[e]],nread/tbatch,tref/tbatch,maxdiff,ndiffcall);
+    }
+
+    free_MAT(like);
+    free_ARRAY(NUC)(calls);
+    free_LIKEBATCH(batch);
+    for ( uint32_t i=0 ; i<nread ; i++){
+        free_MAT(ints[i]);
+        free_MAT(ref[i]);
+        free_ARRAY(NUC)(refcalls[i]);
+    }
+    free(ints); free(ref); free(refcalls); free(lambda);
+    free_MODEL(model);
+    return EXIT_SUCCESS;
+}
+#endif
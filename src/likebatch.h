@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIKEBATCH_H
+#define _LIKEBATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "utility.h"
+#include "matrix.h"
+#include "nuc.h"
+
+/* Likelihoods and calls for a batch of reads sharing the same model.
+ * Storage is structure-of-arrays so that each element is contiguous across
+ * reads: element (cycle,base) of read r is at x[(cycle*NBASE+base)*stride+r]
+ * and the call for cycle of read r at calls[cycle*stride+r]. The stride is
+ * the capacity rounded up to a multiple of LIKEBATCH_LANES so vector code
+ * needs no remainder loop; padding reads are kept at harmless values.
+ *
+ * Only bench-likebatch uses this at present; simNGS itself still calls
+ * likelihood_cycle_intensities once per read.
+ */
+#define LIKEBATCH_LANES 4
+
+typedef struct {
+    uint32_t nread, capacity, stride, ncycle;
+    real_t * ints, * like, * lambda;
+    NUC * calls;
+} * LIKEBATCH;
+
+enum likebatch_engine { LIKEBATCH_AUTO=0, LIKEBATCH_SCALAR, LIKEBATCH_AVX2 };
+
+LIKEBATCH new_LIKEBATCH( const uint32_t capacity, const uint32_t ncycle);
+void free_LIKEBATCH( LIKEBATCH batch);
+void clear_LIKEBATCH( LIKEBATCH batch);
+bool add_LIKEBATCH( LIKEBATCH batch, const MAT ints, const real_t lambda);
+
+bool has_avx2_LIKEBATCH(void);
+enum likebatch_engine likelihood_LIKEBATCH( LIKEBATCH batch, const real_t sdfact, const real_t mu, const MAT prec, enum likebatch_engine engine);
+
+MAT loglike_LIKEBATCH( const LIKEBATCH batch, const uint32_t r, MAT like);
+ARRAY(NUC) calls_LIKEBATCH( const LIKEBATCH batch, const uint32_t r, ARRAY(NUC) calls);
+
+#endif
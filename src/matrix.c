@@ -367,6 +367,19 @@ cleanup:
     return NULL;
 }
 
+real_t * pack_lower_MAT( const MAT mat, real_t * packed){
+    validate(NULL!=mat,NULL);
+    validate(NULL!=packed,NULL);
+    validate(mat->ncol==mat->nrow,NULL);
+    const uint32_t n = mat->nrow;
+    for ( uint32_t row=0 ; row<n ; row++){
+        for ( uint32_t col=0 ; col<=row ; col++){
+            packed[TRI_INDEX(row,col)] = mat->x[col*n+row];
+        }
+    }
+    return packed;
+}
+
 MAT scale_MAT(MAT mat, const real_t f){
     validate(NULL!=mat,NULL);
     const uint32_t nelt = mat->ncol * mat->nrow;
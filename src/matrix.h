@@ -68,6 +68,10 @@ MAT invert_cholesky( MAT mat);
 MAT invert_MAT(const MAT mat);
 MAT trim_MAT( MAT mat, const int mrow, const int mcol, const bool forwards);
 MAT * block_diagonal_MAT( const MAT mat, const int n);
+// Lower triangle packed by rows: element (i,j), j<=i, at TRI_INDEX(i,j)
+#define TRI_INDEX(I,J) ((I)*((I)+1)/2+(J))
+#define TRI_SIZE(N) ((N)*((N)+1)/2)
+real_t * pack_lower_MAT( const MAT mat, real_t * packed);
 MAT scale_MAT(MAT mat, const real_t f);
 MAT transpose( const MAT mat);
 #endif
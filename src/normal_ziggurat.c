@@ -120,7 +120,7 @@ float fn[128] = {
 //
 real_t rstdnorm_zig(void) {
         for (;;) {
-                int32_t j = gen_rand32(); // Possibly negative
+                int32_t j = rand32(); // Possibly negative
                 int32_t i = j & 0x7F;
                 real_t x = (real_t)(j) * (real_t)(wn[i]);
                 if (absInt32(j) < kn[i]) {
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <strings.h>
+#include "outbuf.h"
+
+OUTBUF new_OUTBUF( const size_t cap){
+    OUTBUF out = calloc(1,sizeof(*out));
+    validate(NULL!=out,NULL);
+    out->cap = (cap>0) ? cap : 1;
+    out->buf = malloc(out->cap);
+    if(NULL==out->buf){ free(out); return NULL; }
+    return out;
+}
+
+void free_OUTBUF( OUTBUF out){
+    if(NULL==out){ return; }
+    safe_free(out->buf);
+    safe_free(out);
+}
+
+void grow_OUTBUF( OUTBUF out, const size_t len){
+    size_t cap = out->cap;
+    while(out->len+len>cap){ cap *= 2; }
+    char * buf = realloc(out->buf,cap);
+    if(NULL==buf){ errx(EXIT_FAILURE,"Failed to allocate %zu bytes for output",cap); }
+    out->buf = buf;
+    out->cap = cap;
+}
+
+/* Write entire contents of buffer to fd, retrying short writes, and empty
+ * buffer. Returns false on error, with errno set.
+ */
+bool write_OUTBUF( OUTBUF out, const int fd){
+    validate(NULL!=out,false);
+    const char * ptr = out->buf;
+    size_t left = out->len;
+    while(left>0){
+        ssize_t ret = write(fd,ptr,left);
+        if(ret<0){
+            if(EINTR==errno){ continue; }
+            return false;
+        }
+        ptr += ret;
+        left -= ret;
+    }
+    out->len = 0;
+    return true;
+}
+
+void append_uint_OUTBUF( OUTBUF out, const uint32_t u){
+    char tmp[10];
+    uint32_t n = 0, v = u;
+    do {
+        tmp[n++] = '0' + v%10;
+        v /= 10;
+    } while(v>0);
+    char * ptr = reserve_OUTBUF(out,n);
+    for ( uint32_t i=0 ; i<n ; i++){
+        ptr[i] = tmp[n-i-1];
+    }
+    out->len += n;
+}
+
+/* Same representation as printf's %e */
+void append_real_OUTBUF( OUTBUF out, const real_t x){
+    char * ptr = reserve_OUTBUF(out,REAL_E_MAXLEN+1);
+    out->len += format_real_e(ptr,x);
+}
+
+void printf_OUTBUF( OUTBUF out, const char * fmt, ...){
+    va_list args;
+    va_start(args,fmt);
+    size_t avail = out->cap - out->len;
+    int n = vsnprintf(out->buf+out->len,avail,fmt,args);
+    va_end(args);
+    if(n<0){ errx(EXIT_FAILURE,"Failed to format output"); }
+    if((size_t)n>=avail){
+        reserve_OUTBUF(out,n+1);
+        va_start(args,fmt);
+        vsnprintf(out->buf+out->len,n+1,fmt,args);
+        va_end(args);
+    }
+    out->len += n;
+}
+
+/* Characters for each NUC; anything that isn't a base is ambiguous */
+static const char nuc_char[256] = {
+    [0 ... 255] = 'N',
+    [NUC_A] = 'A', [NUC_C] = 'C', [NUC_G] = 'G', [NUC_T] = 'T'
+};
+
+void append_NUC_OUTBUF( OUTBUF out, const ARRAY(NUC) nucs){
+    char * ptr = reserve_OUTBUF(out,nucs.nelt);
+    for ( uint32_t i=0 ; i<nucs.nelt ; i++){
+        ptr[i] = nuc_char[(unsigned char)nucs.elt[i]];
+    }
+    out->len += nucs.nelt;
+}
+
+/* Characters for the complement of each NUC */
+static const char comp_char[256] = {
+    [0 ... 255] = 'N',
+    [NUC_A] = 'T', [NUC_C] = 'G', [NUC_G] = 'C', [NUC_T] = 'A'
+};
+
+/* Sequence seq with edits applied, reverse complemented if revcomp, written
+ * directly without storing the mutated sequence. When reverse complementing,
+ * the buffer is filled from the end.
+ */
+void append_EDITLIST_OUTBUF( OUTBUF out, const NUC * seq, const EDITLIST edits, const bool revcomp){
+    validate(NULL!=edits,);
+    char * ptr = reserve_OUTBUF(out,edits->length);
+    const char * tab = revcomp ? comp_char : nuc_char;
+    uint32_t scount=0, i = revcomp ? edits->length : 0;
+    #define PUT(C) if(revcomp){ ptr[--i] = tab[(unsigned char)(C)]; } else { ptr[i++] = tab[(unsigned char)(C)]; }
+    for ( uint32_t e=0 ; e<edits->nedit ; e++){
+        const EDIT edit = edits->edit[e];
+        for ( ; scount<edit.pos ; scount++){ PUT(seq[scount]); }
+        switch(edit.type){
+            case 'I': PUT(edit.base); break;
+            case 'D': scount++; break;
+            default:  PUT(edit.base); scount++;
+        }
+    }
+    for ( ; scount<edits->srclen ; scount++){ PUT(seq[scount]); }
+    #undef PUT
+    out->len += edits->length;
+}
+
+void append_PHREDCHAR_OUTBUF( OUTBUF out, const ARRAY(PHREDCHAR) quals){
+    append_OUTBUF(out,quals.elt,quals.nelt);
+}
+
+void append_CIGLIST_OUTBUF( OUTBUF out, const CIGLIST cigar){
+    for ( uint32_t i=0 ; i<cigar.nop ; i++){
+        const CIGOP op = get_CIGLIST(&cigar,i);
+        append_uint_OUTBUF(out,op.num);
+        append_char_OUTBUF(out,op.type);
+    }
+}
+
+/* Same format as show_SEQ */
+void append_SEQ_OUTBUF( OUTBUF out, const SEQ seq, const CSTRING fmt){
+    validate(NULL!=seq,);
+    append_char_OUTBUF(out,hasQual(seq)?'@':'>');
+    if(NULL!=seq->name){
+        append_cstring_OUTBUF(out,seq->name);
+        append_char_OUTBUF(out,' ');
+    }
+    // only print CIGAR if we are writing on original SIMNGS read format
+    if(!strncasecmp(fmt,"orig",4)){ append_CIGLIST_OUTBUF(out,seq->cigar); }
+    append_char_OUTBUF(out,'\n');
+    append_NUC_OUTBUF(out,(ARRAY(NUC)){seq->seq.elt,seq->length});
+    append_char_OUTBUF(out,'\n');
+    if(hasQual(seq)){
+        append_char_OUTBUF(out,'+');
+        if(NULL!=seq->qname){ append_cstring_OUTBUF(out,seq->qname); }
+        append_char_OUTBUF(out,'\n');
+        append_OUTBUF(out,seq->qual.elt,seq->length);
+        append_char_OUTBUF(out,'\n');
+    }
+}
+
+#ifdef BENCH
+#include <time.h>
+#include <math.h>
+#include "random.h"
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+int main ( int argc, char * argv[] ){
+    const uint32_t nvalue = (argc>1) ? strtoul(argv[1],NULL,10) : 4000000;
+    init_gen_rand(1);
+
+    // Values like intensities and likelihoods, plus awkward cases
+    real_t * x = calloc(nvalue,sizeof(*x));
+    for ( uint32_t i=0 ; i<nvalue ; i++){
+        switch(i%4){
+            case 0: x[i] = 1000.0*(runif()-0.2); break;
+            case 1: x[i] = -log(runif()); break;
+            case 2: x[i] = exp(100.0*(runif()-0.5)); break;
+            default: x[i] = round(runif()*2e7)*pow(10.0,(int)(runif()*40)-20)/2.0;
+        }
+    }
+    x[0] = 0.0; x[1] = -0.0; x[2] = 1.0/0.0; x[3] = NAN; x[4] = 9.9999995; x[5] = 1e-310;
+
+    // Agreement with printf
+    uint32_t ndiff = 0;
+    for ( uint32_t i=0 ; i<nvalue ; i++){
+        char ref[64], buf[REAL_E_MAXLEN+1];
+        snprintf(ref,sizeof(ref),"%e",x[i]);
+        format_real_e(buf,x[i]);
+        if(0!=strcmp(ref,buf)){
+            if(ndiff<10){ fprintf(stderr,"Differ for %a: %s != %s\n",(double)x[i],ref,buf); }
+            ndiff++;
+        }
+    }
+    fprintf(stdout,"%u of %u values differ from printf\n",ndiff,nvalue);
+
+    // Text intensities, NBASE values per cycle
+    OUTBUF out = new_OUTBUF(1<<20);
+    double t0 = now();
+    for ( uint32_t i=0 ; i<nvalue ; i++){
+        if(out->len>(1<<20)){ clear_OUTBUF(out); }
+        append_char_OUTBUF(out,(i%NBASE)?' ':'\t');
+        printf_OUTBUF(out,"%e",x[i]);
+    }
+    const double tprintf = now()-t0;
+    t0 = now();
+    for ( uint32_t i=0 ; i<nvalue ; i++){
+        if(out->len>(1<<20)){ clear_OUTBUF(out); }
+        append_char_OUTBUF(out,(i%NBASE)?' ':'\t');
+        append_real_OUTBUF(out,x[i]);
+    }
+    const double tfast = now()-t0;
+    fprintf(stdout,"printf    %12.0f values/sec\n",nvalue/tprintf);
+    fprintf(stdout,"formatter %12.0f values/sec\n",nvalue/tfast);
+
+    free_OUTBUF(out);
+    free(x);
+    return (0==ndiff) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
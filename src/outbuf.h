@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _OUTBUF_H
+#define _OUTBUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "utility.h"
+#include "nuc.h"
+#include "sequence.h"
+
+/* Growable buffer that records are formatted into before being written to
+ * a file descriptor in large blocks. The append functions grow the buffer
+ * as required and never fail other than through lack of memory, which is
+ * fatal.
+ */
+typedef struct {
+    char * buf;
+    size_t len, cap;
+} * OUTBUF;
+
+OUTBUF new_OUTBUF( const size_t cap);
+void free_OUTBUF( OUTBUF out);
+void grow_OUTBUF( OUTBUF out, const size_t len);
+bool write_OUTBUF( OUTBUF out, const int fd);
+
+/* Space for at least len more characters */
+static inline char * reserve_OUTBUF( OUTBUF out, const size_t len){
+    if(out->len+len>out->cap){ grow_OUTBUF(out,len); }
+    return out->buf + out->len;
+}
+
+static inline void clear_OUTBUF( OUTBUF out){
+    out->len = 0;
+}
+
+static inline void append_OUTBUF( OUTBUF out, const char * str, const size_t len){
+    memcpy(reserve_OUTBUF(out,len),str,len);
+    out->len += len;
+}
+
+static inline void append_char_OUTBUF( OUTBUF out, const char c){
+    *reserve_OUTBUF(out,1) = c;
+    out->len++;
+}
+
+static inline void append_cstring_OUTBUF( OUTBUF out, const char * str){
+    append_OUTBUF(out,str,strlen(str));
+}
+
+void append_uint_OUTBUF( OUTBUF out, const uint32_t u);
+void append_real_OUTBUF( OUTBUF out, const real_t x);
+void printf_OUTBUF( OUTBUF out, const char * fmt, ...) __attribute__((format(printf,2,3)));
+void append_NUC_OUTBUF( OUTBUF out, const ARRAY(NUC) nucs);
+void append_PHREDCHAR_OUTBUF( OUTBUF out, const ARRAY(PHREDCHAR) quals);
+void append_CIGLIST_OUTBUF( OUTBUF out, const CIGLIST cigar);
+void append_EDITLIST_OUTBUF( OUTBUF out, const NUC * seq, const EDITLIST edits, const bool revcomp);
+void append_SEQ_OUTBUF( OUTBUF out, const SEQ seq, const CSTRING fmt);
+
+#endif
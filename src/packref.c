@@ -0,0 +1,291 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utility.h"
+#include "packref.h"
+
+#define PACKREF_MAGIC "simNGSp"
+#define PACKREF_BYTEORDER 0x01020304
+#define PACKREF_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t byteorder, version;
+    uint32_t nseq, pad;
+    uint64_t indexoff, filelen;
+} PACKHEADER;
+
+typedef struct {
+    uint64_t nameoff, seqoff, runoff;
+    uint32_t length, nrun;
+} PACKENTRY;
+
+struct _packref {
+    const char * map;
+    size_t maplen;
+    uint32_t nseq;
+    const PACKENTRY * entry;
+};
+
+static inline uint64_t pad8( const uint64_t len){
+    return (len+7) & ~(uint64_t)7;
+}
+
+/* Whether fp, which should not have been read from, is a packed reference */
+bool is_PACKREF( FILE * fp){
+    validate(NULL!=fp,false);
+    char magic[sizeof(PACKREF_MAGIC)];
+    return sizeof(magic)==pread(fileno(fp),magic,sizeof(magic),0)
+        && 0==memcmp(magic,PACKREF_MAGIC,sizeof(magic));
+}
+
+/* Map packed reference, checking that the index is consistent with the
+ * file. Returns NULL, with a warning, if not.
+ */
+PACKREF new_PACKREF( FILE * fp){
+    validate(NULL!=fp,NULL);
+    struct stat st;
+    if(0!=fstat(fileno(fp),&st) || st.st_size<(off_t)sizeof(PACKHEADER)){
+        warnx("Packed reference is truncated");
+        return NULL;
+    }
+    const size_t maplen = st.st_size;
+    const char * map = mmap(NULL,maplen,PROT_READ,MAP_SHARED,fileno(fp),0);
+    if(MAP_FAILED==map){
+        warn("Failed to map packed reference");
+        return NULL;
+    }
+
+    PACKHEADER header;
+    memcpy(&header,map,sizeof(header));
+    if(0!=memcmp(header.magic,PACKREF_MAGIC,sizeof(PACKREF_MAGIC))
+       || PACKREF_BYTEORDER!=header.byteorder || PACKREF_VERSION!=header.version){
+        warnx("Packed reference is of an unsupported version or byte order");
+        goto cleanup;
+    }
+    if(header.filelen!=maplen || header.indexoff>maplen || header.indexoff%8!=0
+       || (maplen-header.indexoff)/sizeof(PACKENTRY)<header.nseq){
+        warnx("Packed reference is truncated or corrupt");
+        goto cleanup;
+    }
+    const PACKENTRY * entry = (const PACKENTRY *)(map + header.indexoff);
+    for ( uint32_t i=0 ; i<header.nseq ; i++){
+        const PACKENTRY * e = entry + i;
+        const uint64_t seqlen = ((uint64_t)e->length+3)/4;
+        const uint64_t runlen = 2*sizeof(uint32_t)*(uint64_t)e->nrun;
+        if( e->nameoff>=header.indexoff || NULL==memchr(map+e->nameoff,'\0',header.indexoff-e->nameoff)
+            || e->seqoff>header.indexoff || seqlen>header.indexoff-e->seqoff
+            || e->runoff%4!=0 || e->runoff>header.indexoff || runlen>header.indexoff-e->runoff ){
+            warnx("Packed reference is corrupt");
+            goto cleanup;
+        }
+    }
+
+    PACKREF ref = calloc(1,sizeof(*ref));
+    if(NULL==ref){ goto cleanup; }
+    ref->map = map;
+    ref->maplen = maplen;
+    ref->nseq = header.nseq;
+    ref->entry = entry;
+    return ref;
+
+cleanup:
+    munmap((void *)map,maplen);
+    return NULL;
+}
+
+void free_PACKREF( PACKREF ref){
+    validate(NULL!=ref,);
+    munmap((void *)ref->map,ref->maplen);
+    free(ref);
+}
+
+uint32_t nseq_PACKREF( const PACKREF ref){
+    validate(NULL!=ref,0);
+    return ref->nseq;
+}
+
+const char * name_PACKREF( const PACKREF ref, const uint32_t i){
+    validate(NULL!=ref,NULL);
+    validate(i<ref->nseq,NULL);
+    return ref->map + ref->entry[i].nameoff;
+}
+
+uint32_t length_PACKREF( const PACKREF ref, const uint32_t i){
+    validate(NULL!=ref,0);
+    validate(i<ref->nseq,0);
+    return ref->entry[i].length;
+}
+
+/* Fragment of sequence i, as sub_SEQ: positions beyond the end of the
+ * sequence are ambiguous. Only the bases of the fragment are unpacked.
+ */
+/* Bases loc to loc+len of sequence i into nuc, ambiguous past its end */
+void unpack_PACKREF( const PACKREF ref, const uint32_t i, const uint32_t loc, const uint32_t len, NUC * nuc){
+    validate(NULL!=ref,);
+    validate(i<ref->nseq,);
+    validate(NULL!=nuc,);
+    const PACKENTRY * e = ref->entry + i;
+    const uint32_t seqend = (loc>=e->length) ? 0 : ((loc+len<e->length)?len:(e->length-loc));
+    const uint8_t * packed = (const uint8_t *)(ref->map + e->seqoff);
+    for ( uint32_t j=0 ; j<seqend ; j++){
+        const uint32_t k = loc + j;
+        nuc[j] = (packed[k>>2] >> (2*(k&3))) & 3;
+    }
+    for ( uint32_t j=seqend ; j<len ; j++){
+        nuc[j] = NUC_AMBIG;
+    }
+
+    // Ambiguous runs overlapping fragment, found by bisection on start
+    const uint32_t * run = (const uint32_t *)(ref->map + e->runoff);
+    uint32_t lo = 0, hi = e->nrun;
+    while(lo<hi){
+        const uint32_t mid = lo + (hi-lo)/2;
+        if(run[2*mid]<loc){ lo = mid+1; } else { hi = mid; }
+    }
+    if(lo>0 && run[2*(lo-1)]+run[2*(lo-1)+1]>loc){ lo--; }
+    for ( uint32_t r=lo ; r<e->nrun && run[2*r]<loc+seqend ; r++){
+        const uint32_t from = (run[2*r]>loc) ? run[2*r]-loc : 0;
+        uint32_t to = run[2*r] + run[2*r+1] - loc;
+        if(to>seqend){ to = seqend; }
+        for ( uint32_t j=from ; j<to ; j++){ nuc[j] = NUC_AMBIG; }
+    }
+}
+
+SEQ sub_PACKREF( const PACKREF ref, const uint32_t i, const uint32_t loc, const uint32_t len){
+    validate(NULL!=ref,NULL);
+    validate(i<ref->nseq,NULL);
+    SEQ subseq = new_SEQ(len,false);
+    validate(NULL!=subseq,NULL);
+    const char * name = name_PACKREF(ref,i);
+    subseq->name = calloc(strlen(name)+1,sizeof(char));
+    if(NULL==subseq->name){ free_SEQ(subseq); return NULL; }
+    strcpy(subseq->name,name);
+    unpack_PACKREF(ref,i,loc,len,subseq->seq.elt);
+    return subseq;
+}
+
+struct _refwriter {
+    FILE * fp;
+    uint64_t len;
+    uint32_t nseq, maxseq;
+    PACKENTRY * entry;
+    bool ok;
+};
+
+static uint64_t write_padded( REFWRITER writer, const void * ptr, const size_t len){
+    static const char zero[8] = {0};
+    const uint64_t off = writer->len;
+    const size_t pad = pad8(len) - len;
+    writer->ok &= (len==fwrite(ptr,1,len,writer->fp)) && (pad==fwrite(zero,1,pad,writer->fp));
+    writer->len += len + pad;
+    return off;
+}
+
+REFWRITER new_REFWRITER( const char * filename){
+    validate(NULL!=filename,NULL);
+    REFWRITER writer = calloc(1,sizeof(*writer));
+    validate(NULL!=writer,NULL);
+    writer->fp = fopen(filename,"wb");
+    if(NULL==writer->fp){
+        free(writer);
+        return NULL;
+    }
+    writer->ok = true;
+    // Header is rewritten once the index is known
+    PACKHEADER header = {0};
+    write_padded(writer,&header,sizeof(header));
+    return writer;
+}
+
+bool add_REFWRITER( REFWRITER writer, const SEQ seq){
+    validate(NULL!=writer,false);
+    validate(NULL!=seq,false);
+    if(writer->nseq==writer->maxseq){
+        writer->maxseq = (0==writer->maxseq) ? 64 : 2*writer->maxseq;
+        PACKENTRY * entry = realloc(writer->entry,writer->maxseq*sizeof(*entry));
+        if(NULL==entry){ return false; }
+        writer->entry = entry;
+    }
+    const uint32_t len = seq->length;
+    uint8_t * packed = calloc((len+3)/4 + 1,1);
+    if(NULL==packed){ return false; }
+    uint32_t nrun = 0, maxrun = 0;
+    uint32_t * run = NULL;
+    for ( uint32_t i=0 ; i<len ; i++){
+        const NUC nuc = seq->seq.elt[i];
+        if(NUC_AMBIG!=nuc){
+            packed[i>>2] |= nuc << (2*(i&3));
+            continue;
+        }
+        if(nrun>0 && run[2*(nrun-1)]+run[2*(nrun-1)+1]==i){
+            run[2*(nrun-1)+1]++;
+            continue;
+        }
+        if(nrun==maxrun){
+            maxrun = (0==maxrun) ? 16 : 2*maxrun;
+            uint32_t * newrun = realloc(run,2*maxrun*sizeof(*run));
+            if(NULL==newrun){ free(run); free(packed); return false; }
+            run = newrun;
+        }
+        run[2*nrun] = i;
+        run[2*nrun+1] = 1;
+        nrun++;
+    }
+
+    PACKENTRY * e = writer->entry + writer->nseq;
+    const char * name = (NULL!=seq->name) ? seq->name : "";
+    e->nameoff = write_padded(writer,name,strlen(name)+1);
+    e->seqoff = write_padded(writer,packed,(len+3)/4);
+    e->runoff = write_padded(writer,run,2*sizeof(*run)*nrun);
+    e->length = len;
+    e->nrun = nrun;
+    writer->nseq++;
+    free(run);
+    free(packed);
+    return writer->ok;
+}
+
+/* Write index and header, returning false if any part of the file could
+ * not be written. The writer is freed.
+ */
+bool finish_REFWRITER( REFWRITER writer){
+    validate(NULL!=writer,false);
+    PACKHEADER header = {
+        .magic = PACKREF_MAGIC,
+        .byteorder = PACKREF_BYTEORDER,
+        .version = PACKREF_VERSION,
+        .nseq = writer->nseq
+    };
+    header.indexoff = write_padded(writer,writer->entry,writer->nseq*sizeof(*writer->entry));
+    header.filelen = writer->len;
+    bool ok = writer->ok && (0==fseek(writer->fp,0,SEEK_SET)) && (1==fwrite(&header,sizeof(header),1,writer->fp));
+    ok &= (0==fclose(writer->fp));
+    free(writer->entry);
+    free(writer);
+    return ok;
+}
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _PACKREF_H
+#define _PACKREF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sequence.h"
+
+/* Reference sequences packed two bits per base, with runs of ambiguous
+ * bases recorded separately, for sampling fragments without holding whole
+ * sequences in memory. The file is memory mapped read-only so concurrent
+ * processes share one copy through the page cache, and fragments are
+ * unpacked on demand.
+ * Layout: header, then for each sequence its name (nul terminated), packed
+ * bases (base i in bits 2(i%4) of byte i/4) and ambiguous runs (uint32_t
+ * start, length pairs in order), each padded to a multiple of eight bytes,
+ * then an index with an entry per sequence. Everything is in host byte
+ * order.
+ */
+typedef struct _packref * PACKREF;
+typedef struct _refwriter * REFWRITER;
+
+bool is_PACKREF( FILE * fp);
+PACKREF new_PACKREF( FILE * fp);
+void free_PACKREF( PACKREF ref);
+uint32_t nseq_PACKREF( const PACKREF ref);
+const char * name_PACKREF( const PACKREF ref, const uint32_t i);
+uint32_t length_PACKREF( const PACKREF ref, const uint32_t i);
+SEQ sub_PACKREF( const PACKREF ref, const uint32_t i, const uint32_t loc, const uint32_t len);
+void unpack_PACKREF( const PACKREF ref, const uint32_t i, const uint32_t loc, const uint32_t len, NUC * nuc);
+
+REFWRITER new_REFWRITER( const char * filename);
+bool add_REFWRITER( REFWRITER writer, const SEQ seq);
+bool finish_REFWRITER( REFWRITER writer);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <err.h>
+#include "utility.h"
+#include "pool.h"
+
+enum slot_state { SLOT_FREE=0, SLOT_READY, SLOT_DONE };
+
+struct _pool {
+    uint32_t nthread, nslot;
+    POOL_FUNCS funcs;
+    void * info;
+    void ** job;
+    enum slot_state * state;
+    // Jobs are numbered in order of submission. Workers claim jobs in order
+    // and the writer consumes them in order; nsubmit-nwrite <= nslot.
+    uint64_t nsubmit, nclaim, nwrite;
+    bool finished;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_free, cond_ready, cond_done;
+    pthread_t * worker, writer;
+};
+
+static void * worker_thread( void * arg){
+    POOL pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while( pool->nclaim==pool->nsubmit && !pool->finished){
+            pthread_cond_wait(&pool->cond_ready,&pool->lock);
+        }
+        if( pool->nclaim==pool->nsubmit){ break; } // Finished and nothing left
+        const uint32_t idx = pool->nclaim % pool->nslot;
+        pool->nclaim++;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->funcs.work(pool->job[idx],pool->info);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->state[idx] = SLOT_DONE;
+        if( idx==(pool->nwrite % pool->nslot) ){ pthread_cond_signal(&pool->cond_done); }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void * writer_thread( void * arg){
+    POOL pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        const uint32_t idx = pool->nwrite % pool->nslot;
+        while( pool->state[idx]!=SLOT_DONE && !(pool->finished && pool->nwrite==pool->nsubmit) ){
+            pthread_cond_wait(&pool->cond_done,&pool->lock);
+        }
+        if( pool->state[idx]!=SLOT_DONE ){ break; }
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->funcs.write(pool->job[idx],pool->info);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->state[idx] = SLOT_FREE;
+        pool->nwrite++;
+        pthread_cond_signal(&pool->cond_free);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+POOL new_POOL( const uint32_t nthread, const uint32_t nslot, const POOL_FUNCS funcs, void * info){
+    validate(nthread>0,NULL);
+    validate(nslot>0,NULL);
+    validate(NULL!=funcs.new_job && NULL!=funcs.work && NULL!=funcs.write,NULL);
+    POOL pool = calloc(1,sizeof(*pool));
+    validate(NULL!=pool,NULL);
+    pool->nthread = nthread;
+    pool->nslot = nslot;
+    pool->funcs = funcs;
+    pool->info = info;
+    pool->job = calloc(nslot,sizeof(*pool->job));
+    pool->state = calloc(nslot,sizeof(*pool->state));
+    pool->worker = calloc(nthread,sizeof(*pool->worker));
+    if(NULL==pool->job || NULL==pool->state || NULL==pool->worker){ goto cleanup; }
+    for ( uint32_t i=0 ; i<nslot ; i++){
+        pool->job[i] = funcs.new_job(info);
+        if(NULL==pool->job[i]){ goto cleanup; }
+    }
+
+    pthread_mutex_init(&pool->lock,NULL);
+    pthread_cond_init(&pool->cond_free,NULL);
+    pthread_cond_init(&pool->cond_ready,NULL);
+    pthread_cond_init(&pool->cond_done,NULL);
+    for ( uint32_t i=0 ; i<nthread ; i++){
+        if(0!=pthread_create(&pool->worker[i],NULL,worker_thread,pool)){
+            errx(EXIT_FAILURE,"Failed to create worker thread %u",i+1);
+        }
+    }
+    if(0!=pthread_create(&pool->writer,NULL,writer_thread,pool)){
+        errx(EXIT_FAILURE,"Failed to create writer thread");
+    }
+    return pool;
+
+cleanup:
+    if(NULL!=pool->job && NULL!=funcs.free_job){
+        for ( uint32_t i=0 ; i<nslot ; i++){
+            if(NULL!=pool->job[i]){ funcs.free_job(pool->job[i]); }
+        }
+    }
+    safe_free(pool->job);
+    safe_free(pool->state);
+    safe_free(pool->worker);
+    safe_free(pool);
+    return NULL;
+}
+
+/* Storage for the next job to submit, blocking until the writer has
+ * finished with it.
+ */
+void * next_job_POOL( POOL pool){
+    validate(NULL!=pool,NULL);
+    const uint32_t idx = pool->nsubmit % pool->nslot;
+    pthread_mutex_lock(&pool->lock);
+    while( pool->state[idx]!=SLOT_FREE ){
+        pthread_cond_wait(&pool->cond_free,&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return pool->job[idx];
+}
+
+void submit_POOL( POOL pool){
+    validate(NULL!=pool,);
+    pthread_mutex_lock(&pool->lock);
+    pool->state[pool->nsubmit % pool->nslot] = SLOT_READY;
+    pool->nsubmit++;
+    pthread_cond_signal(&pool->cond_ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Waits for all submitted jobs to be written before freeing pool */
+void free_POOL( POOL pool){
+    validate(NULL!=pool,);
+    pthread_mutex_lock(&pool->lock);
+    pool->finished = true;
+    pthread_cond_broadcast(&pool->cond_ready);
+    pthread_cond_broadcast(&pool->cond_done);
+    pthread_mutex_unlock(&pool->lock);
+
+    for ( uint32_t i=0 ; i<pool->nthread ; i++){
+        pthread_join(pool->worker[i],NULL);
+    }
+    pthread_join(pool->writer,NULL);
+
+    if(NULL!=pool->funcs.free_job){
+        for ( uint32_t i=0 ; i<pool->nslot ; i++){
+            pool->funcs.free_job(pool->job[i]);
+        }
+    }
+    pthread_cond_destroy(&pool->cond_done);
+    pthread_cond_destroy(&pool->cond_ready);
+    pthread_cond_destroy(&pool->cond_free);
+    pthread_mutex_destroy(&pool->lock);
+    safe_free(pool->job);
+    safe_free(pool->state);
+    safe_free(pool->worker);
+    safe_free(pool);
+}
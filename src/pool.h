@@ -0,0 +1,48 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Pool of worker threads with ordered output.
+ * A single producer fills job slots and submits them. Any worker may process
+ * a submitted job but the "write" function is called by one writer thread
+ * strictly in the order that jobs were submitted, after which the slot is
+ * recycled. Job memory is created once per slot by "new_job" so steady-state
+ * operation need not allocate.
+ */
+typedef struct {
+    void * (*new_job)(void * info);
+    void (*free_job)(void * job);
+    void (*work)(void * job, void * info);
+    void (*write)(void * job, void * info);
+} POOL_FUNCS;
+
+typedef struct _pool * POOL;
+
+POOL new_POOL( const uint32_t nthread, const uint32_t nslot, const POOL_FUNCS funcs, void * info);
+void * next_job_POOL( POOL pool);
+void submit_POOL( POOL pool);
+void free_POOL( POOL pool);
+
+#endif
@@ -20,11 +20,66 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "utility.h"
 #include "random.h"
 #include <math.h>
 
+const char * rngtype_str[] = { "sfmt", "counter" };
+__thread RNGSTREAM rng_stream = NULL;
+
+RNGSTREAM new_RNGSTREAM( const uint64_t seed){
+    RNGSTREAM rng = calloc(1,sizeof(*rng));
+    validate(NULL!=rng,NULL);
+    rng->key[0] = (uint32_t)seed;
+    rng->key[1] = (uint32_t)(seed>>32);
+    return rng;
+}
+
+void free_RNGSTREAM( RNGSTREAM rng){
+    if(NULL==rng){ return; }
+    if(rng_stream==rng){ rng_stream = NULL; }
+    free(rng);
+}
+
+/* Position stream at start of substream "sub" for read "idx" */
+void seek_RNGSTREAM( RNGSTREAM rng, const uint64_t idx, const uint32_t sub){
+    validate(NULL!=rng,);
+    rng->ctr[0] = (uint32_t)idx;
+    rng->ctr[1] = (uint32_t)(idx>>32);
+    rng->ctr[2] = sub;
+    rng->ctr[3] = 0;
+    rng->nbuf = 0;
+}
+
+/* Set current stream for calling thread, returning previous */
+RNGSTREAM use_RNGSTREAM( RNGSTREAM rng){
+    RNGSTREAM prev = rng_stream;
+    rng_stream = rng;
+    return prev;
+}
+
+/* Philox4x32-10 block function.
+ * Salmon et al. (2011) "Parallel random numbers: as easy as 1, 2, 3"
+ */
+void refill_RNGSTREAM( RNGSTREAM rng){
+    uint32_t c0=rng->ctr[0], c1=rng->ctr[1], c2=rng->ctr[2], c3=rng->ctr[3];
+    uint32_t k0=rng->key[0], k1=rng->key[1];
+    for ( int r=0 ; r<10 ; r++){
+        const uint64_t p0 = (uint64_t)0xD2511F53 * c0;
+        const uint64_t p1 = (uint64_t)0xCD9E8D57 * c2;
+        const uint32_t n0 = (uint32_t)(p1>>32) ^ c1 ^ k0;
+        const uint32_t n2 = (uint32_t)(p0>>32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1; c3 = (uint32_t)p0;
+        c0 = n0; c2 = n2;
+        k0 += 0x9E3779B9; k1 += 0xBB67AE85;
+    }
+    rng->buf[0] = c3; rng->buf[1] = c2; rng->buf[2] = c1; rng->buf[3] = c0;
+    rng->nbuf = 4;
+    rng->ctr[3]++;
+}
+
 uint32_t rchoose( const real_t * p, const uint32_t n){
     real_t x = runif();
     uint32_t i=0;
@@ -42,12 +97,12 @@ real_t rgamma1( const real_t shape){
         const real_t sh2m1 = sqrt(2.0*shape-1.0);
 
 start:
-        y = tan(M_PI*genrand_real3());
+        y = tan(M_PI*runif32());
         x = sh2m1*y + shm1;
 
         if(x<=0.0){ goto start;}
         
-        v = genrand_real3();
+        v = runif32();
         if(v>(1.0+y*y)*exp(shm1*log(x/shm1)-sh2m1*y)){ goto start;}
         return x;
 }
@@ -66,9 +121,9 @@ real_t rgamma2 ( const real_t shape){
         const real_t c = a+b;
         
 start:
-        u = genrand_real3();
+        u = runif32();
         x = (u<=a/c) ? -2.0 * log1p(-pow(c*u,1.0/shape)/2.0) : -log( c*(1.0-u)/(shape*pdsh) );
-        v = genrand_real3();
+        v = runif32();
         if(x<=d){
                 const real_t p = pow(x,shape-1.0)*exp(-x/2.0)/( exp2(shape-1.0)*pow(-expm1(-x/2.0),shape-1.0) );
                 if(v>p){ goto start; }
@@ -81,10 +136,20 @@ start:
 
 /* Exponential distribution with rate */
 real_t rexp(const real_t r){
-        return -log(genrand_real3())/r;
+        return -log(runif32())/r;
 }
 
 
+/* Geometric distribution: number of failures before first success, where
+ * each trial succeeds with probability p. Saturates at UINT32_MAX.
+ */
+uint32_t rgeom(const real_t p){
+        if(p>=1.0){ return 0; }
+        if(p<=0.0){ return UINT32_MAX; }
+        const real_t x = floor(log(runif())/log1p(-p));
+        return (x<UINT32_MAX)?(uint32_t)x:UINT32_MAX;
+}
+
 real_t rgamma(const real_t shape, const real_t scale){
         assert(shape>0.0 && scale>0.0);
         if(shape==1.0){ return scale*rexp(1.0); }
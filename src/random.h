@@ -22,17 +22,67 @@
 #ifndef _RANDOM_H
 #define _RANDOM_H
 
+#include <stdint.h>
 #include "SFMT-src-1.3/SFMT.h"
 #include "utility.h"
 
+/* Counter-based random number streams (Philox4x32-10).
+ * A stream is keyed by the seed and positioned by a read index and
+ * substream, so the random numbers used for any read do not depend on
+ * how many were drawn before it. Each thread has a current stream; when
+ * it is NULL, random numbers come from the global SFMT generator.
+ *
+ * Substreams from RNG_SUB_LIBRARY up are reserved for sampling library
+ * fragments, indexed by chunk rather than read, so a library and the reads
+ * simulated from it never share random numbers when given the same seed.
+ */
+#define RNG_SUB_LIBRARY 0x80000000u
+
+typedef struct {
+    uint32_t key[2];
+    uint32_t ctr[4];
+    uint32_t buf[4];
+    uint32_t nbuf;
+} * RNGSTREAM;
+
+enum rngtype { RNG_SFMT=0, RNG_COUNTER };
+extern const char * rngtype_str[];
+
+extern __thread RNGSTREAM rng_stream;
+
+RNGSTREAM new_RNGSTREAM( const uint64_t seed);
+void free_RNGSTREAM( RNGSTREAM rng);
+void seek_RNGSTREAM( RNGSTREAM rng, const uint64_t idx, const uint32_t sub);
+RNGSTREAM use_RNGSTREAM( RNGSTREAM rng);
+void refill_RNGSTREAM( RNGSTREAM rng);
+
+inline static uint32_t rand32(void){
+    RNGSTREAM rng = rng_stream;
+    if(NULL==rng){ return gen_rand32(); }
+    if(0==rng->nbuf){ refill_RNGSTREAM(rng); }
+    return rng->buf[--rng->nbuf];
+}
+
+inline static uint64_t rand64(void){
+    if(NULL==rng_stream){ return gen_rand64(); }
+    const uint64_t hi = rand32();
+    return (hi<<32) | rand32();
+}
+
 //Uniform RV on (0,1)                       
 inline static real_t runif(void){
-	return (((real_t)gen_rand64()) + 0.5) * (1.0/18446744073709551616.0L);
+	return (((real_t)rand64()) + 0.5) * (1.0/18446744073709551616.0L);
+}
+
+//Uniform RV on (0,1) with 32bit resolution
+inline static real_t runif32(void){
+	return (((real_t)rand32()) + 0.5) * (1.0/4294967296.0);
 }
 
 uint32_t rchoose( const real_t * p, const uint32_t n);
 
 real_t rexp(const real_t r);
+uint32_t rgeom(const real_t p);
 real_t rgamma(const real_t shape, const real_t scale);
 real_t rchisq(const real_t df);
 
@@ -0,0 +1,456 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utility.h"
+#include "asyncin.h"
+#include "seqreader.h"
+#include "fragformat.h"
+
+#define SEQREADER_BLOCKSIZE (1<<20)
+
+struct _seqreader {
+    int fd;
+    bool mapped, eof;
+    char * buf;             // Mapping or buffer
+    size_t len, cap, pos;   // Bytes available, buffer size and start of next record
+    ASYNCIN zin;            // Decompressed input, if compressed
+    bool fragments;         // Binary fragment stream rather than text
+    FRAGHEADER header;
+    char * source;          // Name of sequence fragments are from
+    OUTBUF scratch;
+    CIGLIST cigar;          // Of last fragment, storage reused
+};
+
+/* Conversion of characters to nucleotides. Whitespace is skipped and
+ * anything unrecognised is passed to nuc_from_char, which warns.
+ */
+#define NUCTAB_SKIP  0xfe
+#define NUCTAB_OTHER 0xff
+static const uint8_t nuc_table[256] = {
+    [0 ... 255] = NUCTAB_OTHER,
+    ['A'] = NUC_A, ['C'] = NUC_C, ['G'] = NUC_G, ['T'] = NUC_T, ['N'] = NUC_AMBIG,
+    ['a'] = NUC_A, ['c'] = NUC_C, ['g'] = NUC_G, ['t'] = NUC_T, ['n'] = NUC_AMBIG,
+    [' '] = NUCTAB_SKIP, ['\t'] = NUCTAB_SKIP, ['\n'] = NUCTAB_SKIP,
+    ['\v'] = NUCTAB_SKIP, ['\f'] = NUCTAB_SKIP, ['\r'] = NUCTAB_SKIP
+};
+
+static inline bool is_space( const char c){
+    return NUCTAB_SKIP==nuc_table[(uint8_t)c];
+}
+
+static bool fill_SEQREADER( SEQREADER reader);
+static bool ensure_SEQREADER( SEQREADER reader, const size_t n);
+static SEQREADER start_SEQREADER( SEQREADER reader);
+
+/* Reader for fp, which should not have been read from. Gzip compressed
+ * input is recognised and decompressed on another thread, nthread threads
+ * being used for BGZF.
+ */
+SEQREADER new_SEQREADER( FILE * fp, const uint32_t nthread){
+    validate(NULL!=fp,NULL);
+    SEQREADER reader = calloc(1,sizeof(*reader));
+    validate(NULL!=reader,NULL);
+    reader->fd = fileno(fp);
+
+    struct stat st;
+    if( 0==fstat(reader->fd,&st) && S_ISREG(st.st_mode) && st.st_size>0 ){
+        char magic[2];
+        const bool compressed = (sizeof(magic)==pread(reader->fd,magic,sizeof(magic),0)) && is_gzip_ASYNCIN(magic,sizeof(magic));
+        void * map = compressed ? MAP_FAILED : mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,reader->fd,0);
+        if(MAP_FAILED!=map){
+            madvise(map,st.st_size,MADV_SEQUENTIAL);
+            reader->mapped = true;
+            reader->eof = true;
+            reader->buf = map;
+            reader->len = reader->cap = st.st_size;
+            return start_SEQREADER(reader);
+        }
+    }
+
+    reader->cap = SEQREADER_BLOCKSIZE;
+    reader->buf = malloc(reader->cap);
+    if(NULL==reader->buf){
+        free(reader);
+        return NULL;
+    }
+    // Input read so far is handed to decompression if compressed
+    while( reader->len<2 && fill_SEQREADER(reader) );
+    if(is_gzip_ASYNCIN(reader->buf,reader->len)){
+        reader->zin = new_ASYNCIN(reader->fd,reader->buf,reader->len,nthread);
+        if(NULL==reader->zin){
+            free_SEQREADER(reader);
+            return NULL;
+        }
+        reader->len = 0;
+        reader->eof = false;
+    }
+    return start_SEQREADER(reader);
+}
+
+/* Recognise a binary fragment stream and read its header */
+static SEQREADER start_SEQREADER( SEQREADER reader){
+    if( !ensure_SEQREADER(reader,sizeof(FRAGHEADER)) || !is_FRAGFORMAT(reader->buf,reader->len) ){
+        return reader;
+    }
+    memcpy(&reader->header,reader->buf,sizeof(FRAGHEADER));
+    reader->pos = sizeof(FRAGHEADER);
+    reader->fragments = true;
+    reader->scratch = new_OUTBUF(256);
+    if(!check_FRAGHEADER(&reader->header) || NULL==reader->scratch){
+        free_SEQREADER(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void free_SEQREADER( SEQREADER reader){
+    validate(NULL!=reader,);
+    if(reader->mapped){
+        munmap(reader->buf,reader->cap);
+    } else {
+        free(reader->buf);
+    }
+    if(NULL!=reader->zin){ free_ASYNCIN(reader->zin); }
+    if(NULL!=reader->scratch){ free_OUTBUF(reader->scratch); }
+    free_CIGLIST(reader->cigar);
+    safe_free(reader->source);
+    free(reader);
+}
+
+/* Read more input onto the end of the buffer. When the buffer is full, the
+ * current record is moved to its start or, if the record already fills it,
+ * the buffer is grown. Offsets from the start of the current record survive
+ * either. Returns false if no more input is available.
+ */
+static bool fill_SEQREADER( SEQREADER reader){
+    if(reader->eof){ return false; }
+    if(reader->len==reader->cap){
+        if(reader->pos>0){
+            memmove(reader->buf,reader->buf+reader->pos,reader->len-reader->pos);
+            reader->len -= reader->pos;
+            reader->pos = 0;
+        } else {
+            char * buf = realloc(reader->buf,2*reader->cap);
+            if(NULL==buf){ errx(EXIT_FAILURE,"Failed to allocate memory for input"); }
+            reader->buf = buf;
+            reader->cap *= 2;
+        }
+    }
+    for(;;){
+        const ssize_t ret = (NULL!=reader->zin) ? read_ASYNCIN(reader->zin,reader->buf+reader->len,reader->cap-reader->len)
+                                                : read(reader->fd,reader->buf+reader->len,reader->cap-reader->len);
+        if(ret>0){
+            reader->len += ret;
+            return true;
+        }
+        if(ret<0 && EINTR==errno){ continue; }
+        if(ret<0){ warn("Failed to read input"); }
+        reader->eof = true;
+        return false;
+    }
+}
+
+/* Make at least n bytes available from the start of the next record.
+ * Returns false if the input ends first.
+ */
+static bool ensure_SEQREADER( SEQREADER reader, const size_t n){
+    while( reader->len-reader->pos<n ){
+        if(!fill_SEQREADER(reader)){ return false; }
+    }
+    return true;
+}
+
+/* Offset of first occurrence of c at or after from, both relative to the
+ * start of the current record, reading more input as necessary. Returns the
+ * length of input available from the record if not found.
+ */
+static size_t find_SEQREADER( SEQREADER reader, size_t from, const char c){
+    for(;;){
+        const size_t len = reader->len - reader->pos;
+        if(from<len){
+            const char * rec = reader->buf + reader->pos;
+            const char * ptr = memchr(rec+from,c,len-from);
+            if(NULL!=ptr){ return ptr - rec; }
+            from = len;
+        }
+        if(!fill_SEQREADER(reader)){ return reader->len - reader->pos; }
+    }
+}
+
+/* Number of non-whitespace characters in span */
+static size_t count_nonspace( const char * str, const size_t len){
+    size_t n = 0;
+    for ( size_t i=0 ; i<len ; i++){
+        n += !is_space(str[i]);
+    }
+    return n;
+}
+
+/* Next record from input. Returns false at end of input or if the input is
+ * not a FASTA or FASTQ record.
+ */
+bool next_SEQREADER( SEQREADER reader, SEQVIEW * view){
+    validate(NULL!=reader,false);
+    validate(NULL!=view,false);
+    if(reader->fragments){ return false; }
+    // Offsets are from the start of the record, so survive the buffer being
+    // compacted or grown as more input is read.
+    if(reader->pos==reader->len && !fill_SEQREADER(reader)){ return false; }
+    const char type = reader->buf[reader->pos];
+    if('>'!=type && '@'!=type){ return false; }
+
+    const size_t name = 1;
+    const size_t nameend = find_SEQREADER(reader,name,'\n');
+    const size_t seq = nameend + 1;
+    if(seq>=reader->len-reader->pos && !fill_SEQREADER(reader)){ return false; }
+    size_t seqend, qname = 0, qnameend = 0, qual = 0, qualend = 0, next;
+    if('>'==type){
+        seqend = find_SEQREADER(reader,seq,'>');
+        next = seqend;
+    } else {
+        seqend = find_SEQREADER(reader,seq,'+');
+        if(seqend==reader->len-reader->pos){ return false; }
+        qname = seqend + 1;
+        qnameend = find_SEQREADER(reader,qname,'\n');
+        // Qualities run over as many lines as needed to match the sequence
+        const size_t nseq = count_nonspace(reader->buf+reader->pos+seq,seqend-seq);
+        size_t nqual = 0;
+        qual = qualend = qnameend + 1;
+        while( nqual<nseq && qualend<reader->len-reader->pos ){
+            const size_t nl = find_SEQREADER(reader,qualend,'\n');
+            nqual += count_nonspace(reader->buf+reader->pos+qualend,nl-qualend);
+            qualend = (nl<reader->len-reader->pos) ? nl+1 : nl;
+        }
+        if(nqual!=nseq){ return false; }
+        // Skip blank lines before next record
+        for(;;){
+            while( qualend<reader->len-reader->pos && is_space(reader->buf[reader->pos+qualend]) ){ qualend++; }
+            if(qualend<reader->len-reader->pos || !fill_SEQREADER(reader)){ break; }
+        }
+        next = qualend;
+    }
+
+    const char * buf = reader->buf + reader->pos;
+    reader->pos += next;
+    view->name = buf + name;
+    view->namelen = nameend - name;
+    view->seq = buf + seq;
+    view->seqlen = seqend - seq;
+    if('@'==type){
+        view->qname = buf + qname;
+        view->qnamelen = qnameend - qname;
+        view->qual = buf + qual;
+        view->quallen = qualend - qual;
+    } else {
+        view->qname = view->qual = NULL;
+        view->qnamelen = view->quallen = 0;
+    }
+    return true;
+}
+
+static char * cstring_from_span( const char * str, const size_t len){
+    char * cstr = malloc(len+1);
+    if(NULL==cstr){ return NULL; }
+    memcpy(cstr,str,len);
+    cstr[len] = '\0';
+    return cstr;
+}
+
+/* Bases of record converted into nuc, which has room for view->seqlen
+ * bases, skipping whitespace. Returns the number of bases.
+ */
+uint32_t nucs_from_SEQVIEW( const SEQVIEW * view, NUC * nuc){
+    validate(NULL!=view,0);
+    validate(NULL!=nuc,0);
+    uint32_t n = 0;
+    for ( size_t i=0 ; i<view->seqlen ; i++){
+        uint8_t v = nuc_table[(uint8_t)view->seq[i]];
+        if(v>=NUCTAB_SKIP){
+            if(NUCTAB_SKIP==v){ continue; }
+            v = nuc_from_char(view->seq[i]);
+        }
+        nuc[n++] = v;
+    }
+    return n;
+}
+
+/* Whether record has a quality for each of its n bases */
+static bool has_quals( const SEQVIEW * view, const uint32_t n){
+    uint32_t nqual = 0;
+    for ( size_t i=0 ; i<view->quallen && nqual<n ; i++){
+        if(!is_space(view->qual[i])){ nqual++; }
+    }
+    return nqual==n;
+}
+
+/* Sequence from record, converting bases straight into the sequence's
+ * storage.
+ */
+SEQ sequence_from_SEQVIEW( const SEQVIEW * view){
+    validate(NULL!=view,NULL);
+    validate(view->seqlen<=UINT32_MAX,NULL);
+    SEQ seq = new_SEQ(view->seqlen,NULL!=view->qual);
+    validate(NULL!=seq,NULL);
+    seq->name = cstring_from_span(view->name,view->namelen);
+    if(NULL==seq->name){ goto cleanup; }
+    if(NULL!=view->qual){
+        seq->qname = cstring_from_span(view->qname,view->qnamelen);
+        if(NULL==seq->qname){ goto cleanup; }
+    }
+
+    const uint32_t n = nucs_from_SEQVIEW(view,seq->seq.elt);
+    if(NULL!=view->qual){
+        uint32_t nqual = 0;
+        for ( size_t i=0 ; i<view->quallen && nqual<n ; i++){
+            if(is_space(view->qual[i])){ continue; }
+            seq->qual.elt[nqual++] = phredchar_from_char(view->qual[i]);
+        }
+        if(nqual!=n){ goto cleanup; }
+    }
+
+    // Allocated for the whole span, which may have included whitespace
+    if(n<view->seqlen){
+        seq->length = n;
+        if(n>0){
+            seq->seq = resize_ARRAY(NUC)(seq->seq,n);
+            if(NULL==seq->seq.elt){ goto cleanup; }
+            if(NULL!=view->qual){
+                seq->qual = resize_ARRAY(PHREDCHAR)(seq->qual,n);
+                if(NULL==seq->qual.elt){ goto cleanup; }
+            }
+        } else {
+            seq->seq.nelt = 0;
+            seq->qual.nelt = 0;
+        }
+    }
+    seq->cigar = pushStart_CIGLIST(seq->cigar,'M',n);
+    return seq;
+
+cleanup:
+    free_SEQ(seq);
+    return NULL;
+}
+
+/* As sequence_from_SEQVIEW but into storage from arena. Room is taken for
+ * the whole span and any whitespace left unused. Returns false if the
+ * record is invalid.
+ */
+bool arenaseq_from_SEQVIEW( const SEQVIEW * view, ARENA arena, ARENASEQ * aseq){
+    validate(NULL!=view,false);
+    validate(NULL!=arena,false);
+    validate(NULL!=aseq,false);
+    validate(view->seqlen<UINT32_MAX,false);
+    aseq->name = alloc_ARENA(arena,view->namelen+1);
+    aseq->seq = new_ARRAY_ARENA(NUC,arena,view->seqlen+1);
+    if(NULL==aseq->name || NULL==aseq->seq.elt){ return false; }
+    memcpy(aseq->name,view->name,view->namelen);
+    aseq->seq.nelt = nucs_from_SEQVIEW(view,aseq->seq.elt);
+    if(NULL!=view->qual && !has_quals(view,aseq->seq.nelt)){ return false; }
+    aseq->cigar = pushEnd_CIGLIST(null_CIGLIST,'M',aseq->seq.nelt);
+    return true;
+}
+
+/* Next fragment record of binary stream, skipping other records. Records
+ * are decoded in place from large blocks of input.
+ */
+static bool next_fragment( SEQREADER reader, const char ** rec, uint32_t * reclen){
+    const size_t taglen = 2*sizeof(uint32_t);
+    while( ensure_SEQREADER(reader,taglen) ){
+        uint32_t tag[2];
+        memcpy(tag,reader->buf+reader->pos,taglen);
+        if(!ensure_SEQREADER(reader,taglen+tag[1])){ break; }
+        *rec = reader->buf + reader->pos + taglen;
+        *reclen = tag[1];
+        reader->pos += taglen + tag[1];
+        if(FRAGFORMAT_SOURCE==tag[0]){
+            free(reader->source);
+            reader->source = malloc(tag[1]+1);
+            if(NULL==reader->source){ errx(EXIT_FAILURE,"Failed to allocate memory for input"); }
+            memcpy(reader->source,*rec,tag[1]);
+            reader->source[tag[1]] = '\0';
+        } else if(FRAGFORMAT_FRAGMENT==tag[0]){
+            return true;
+        }
+    }
+    if(reader->pos<reader->len){ warnx("Fragment stream is truncated"); }
+    return false;
+}
+
+static SEQ fragment_from_SEQREADER( SEQREADER reader){
+    const char * rec;
+    uint32_t reclen;
+    if(!next_fragment(reader,&rec,&reclen)){ return NULL; }
+    SEQ seq = sequence_from_FRAGFORMAT(&reader->header,reader->source,rec,reclen,reader->scratch);
+    if(NULL==seq){ warnx("Fragment stream is corrupt"); }
+    return seq;
+}
+
+/* Fragment into storage from arena. The cigar is kept by the reader, whose
+ * storage is reused for every fragment, and lent to aseq.
+ */
+static bool arenafragment_from_SEQREADER( SEQREADER reader, ARENA arena, ARENASEQ * aseq){
+    const char * rec;
+    uint32_t reclen;
+    if(!next_fragment(reader,&rec,&reclen)){ return false; }
+    FRAGVIEW view;
+    if(!view_FRAGFORMAT(rec,reclen,&view)){ goto corrupt; }
+    clear_OUTBUF(reader->scratch);
+    append_name_FRAGVIEW(reader->scratch,&reader->header,reader->source,&view);
+    aseq->name = strdup_ARENA(arena,reader->scratch->buf);
+    aseq->seq = new_ARRAY_ARENA(NUC,arena,view.length+1);
+    if(NULL==aseq->name || NULL==aseq->seq.elt){ return false; }
+    aseq->seq.nelt = view.length;
+    reader->cigar.nop = 0;
+    if(!cigar_from_FRAGVIEW(&view,&reader->cigar)){ goto corrupt; }
+    if(!nucs_from_FRAGVIEW(&view,aseq->seq.elt)){ goto corrupt; }
+    aseq->cigar = reader->cigar;
+    aseq->cigar.cap = 0;
+    return true;
+
+corrupt:
+    warnx("Fragment stream is corrupt");
+    return false;
+}
+
+SEQ sequence_from_SEQREADER( SEQREADER reader){
+    if(reader->fragments){ return fragment_from_SEQREADER(reader); }
+    SEQVIEW view;
+    if(!next_SEQREADER(reader,&view)){ return NULL; }
+    return sequence_from_SEQVIEW(&view);
+}
+
+/* Next record into storage from arena. Returns false at the end of input or
+ * if the record is invalid.
+ */
+bool arenaseq_from_SEQREADER( SEQREADER reader, ARENA arena, ARENASEQ * aseq){
+    validate(NULL!=reader,false);
+    if(reader->fragments){ return arenafragment_from_SEQREADER(reader,arena,aseq); }
+    SEQVIEW view;
+    if(!next_SEQREADER(reader,&view)){ return false; }
+    return arenaseq_from_SEQVIEW(&view,arena,aseq);
+}
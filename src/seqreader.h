@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SEQREADER_H
+#define _SEQREADER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sequence.h"
+#include "arena.h"
+
+/* Reader for FASTA and FASTQ records. Regular files are memory mapped and
+ * records returned as views into the mapping; other input, such as pipes,
+ * is read in large blocks into a buffer that grows to hold the longest
+ * record. Gzip and BGZF input is decompressed transparently. Records are
+ * delimited as by sequence_from_fasta and sequence_from_fastq: a FASTA
+ * sequence runs to the next '>' and whitespace within sequence or
+ * qualities is ignored.
+ * A binary fragment stream, see fragformat.h, is also recognised; its
+ * fragments are only returned by sequence_from_SEQREADER and
+ * arenaseq_from_SEQREADER, as the sequences that would have been read from
+ * simLibrary's text output.
+ */
+typedef struct _seqreader * SEQREADER;
+
+/* Spans of a record. Not nul terminated and only valid until the next
+ * record is read. qual is NULL for FASTA records.
+ */
+typedef struct {
+    const char * name, * seq, * qname, * qual;
+    size_t namelen, seqlen, qnamelen, quallen;
+} SEQVIEW;
+
+/* Record converted straight into storage from an arena, for callers that
+ * keep reads there and have no use for a SEQ. Name and bases are from the
+ * arena; cigar may be borrowed from the reader, so is only valid until the
+ * next record is read. Qualities are checked but not kept.
+ */
+typedef struct {
+    char * name;
+    ARRAY(NUC) seq;
+    CIGLIST cigar;
+} ARENASEQ;
+
+SEQREADER new_SEQREADER( FILE * fp, const uint32_t nthread);
+void free_SEQREADER( SEQREADER reader);
+bool next_SEQREADER( SEQREADER reader, SEQVIEW * view);
+uint32_t nucs_from_SEQVIEW( const SEQVIEW * view, NUC * nuc);
+SEQ sequence_from_SEQVIEW( const SEQVIEW * view);
+SEQ sequence_from_SEQREADER( SEQREADER reader);
+bool arenaseq_from_SEQVIEW( const SEQVIEW * view, ARENA arena, ARENASEQ * aseq);
+bool arenaseq_from_SEQREADER( SEQREADER reader, ARENA arena, ARENASEQ * aseq);
+
+#endif
@@ -32,74 +32,97 @@
 #include "mystring.h"
 #include "random.h"
 
+static inline CIGOP * ops_CIGLIST(CIGLIST * cigar){
+	return (NULL!=cigar->op)?cigar->op:cigar->inline_op;
+}
+
 void free_CIGLIST(CIGLIST cigar){
-        CIGELT elt = cigar.start;
-        while(NULL!=elt){
-                CIGELT nxtelt = elt->nxt;
-                free(elt);
-                elt = nxtelt;
-        }
+	if(cigar.cap>0){ free(cigar.op); }
+}
+
+/* Storage for n operations of an empty list: inline if they fit, otherwise
+ * from arena, if not NULL, or owned by the list.
+ */
+static CIGOP * alloc_CIGLIST(CIGLIST * cigar, const uint32_t n, ARENA arena){
+	cigar->op = NULL;
+	cigar->cap = 0;
+	if(n<=CIGLIST_INLINE){ return cigar->inline_op; }
+	if(NULL!=arena){
+		cigar->op = alloc_ARENA(arena,n*sizeof(CIGOP));
+	} else {
+		cigar->op = malloc(n*sizeof(CIGOP));
+		if(NULL!=cigar->op){ cigar->cap = n; }
+	}
+	return cigar->op;
+}
+
+/* Make cigar writable in place, in forward order and with room for n
+ * operations. Borrowed operations are copied. On failure any storage owned
+ * by cigar is freed and it is set to the empty list.
+ */
+static bool reserve_CIGLIST(CIGLIST * cigar, const uint32_t n){
+	const bool writable = !cigar->reverse && (NULL==cigar->op || cigar->cap>0);
+	if(writable){
+		const uint32_t cap = (NULL!=cigar->op)?cigar->cap:CIGLIST_INLINE;
+		if(n<=cap){ return true; }
+		if(NULL!=cigar->op){
+			const uint32_t newcap = (n>2*cap)?n:2*cap;
+			CIGOP * op = realloc(cigar->op,newcap*sizeof(CIGOP));
+			if(NULL==op){ goto cleanup; }
+			cigar->op = op;
+			cigar->cap = newcap;
+			return true;
+		}
+	}
+	// Copy into new storage owned by cigar
+	CIGLIST newcig = null_CIGLIST;
+	const uint32_t newcap = (n>2*CIGLIST_INLINE)?n:2*CIGLIST_INLINE;
+	CIGOP * op = alloc_CIGLIST(&newcig,(n>CIGLIST_INLINE)?newcap:n,NULL);
+	if(NULL==op){ goto cleanup; }
+	for ( uint32_t i=0 ; i<cigar->nop ; i++){
+		op[i] = get_CIGLIST(cigar,i);
+	}
+	newcig.nop = cigar->nop;
+	free_CIGLIST(*cigar);
+	*cigar = newcig;
+	return true;
+
+cleanup:
+	free_CIGLIST(*cigar);
+	*cigar = null_CIGLIST;
+	return false;
 }
 
 // Drops deletions from beginning of cigar string
 CIGLIST compact_CIGLIST(CIGLIST cigar){
-	CIGELT elt = cigar.start;
-	if(NULL==elt){ return cigar; }
-
-	if('D'==elt->type){
-		CIGELT nxtelt = elt->nxt;
-		free(elt);
-		if(cigar.start==cigar.end){
-			cigar.end = nxtelt;
-		}
-		cigar.start = nxtelt;
+	if(0==cigar.nop || 'D'!=get_CIGLIST(&cigar,0).type){ return cigar; }
+	if(!cigar.reverse){
+		CIGOP * op = ops_CIGLIST(&cigar);
+		memmove(op,op+1,(cigar.nop-1)*sizeof(CIGOP));
 	}
+	cigar.nop--;
 	return cigar;
 }
 
 CIGLIST pushStart_CIGLIST(CIGLIST cigar, const char type, const int num){
-	CIGELT elt = malloc(sizeof(*elt));
-	if(NULL==elt){ 
-		free_CIGLIST(cigar);
-		return null_CIGLIST;
-	}
-
-	elt->nxt = cigar.start;
-	elt->type = type;
-	elt->num = num;
-
-	cigar.start = elt;
-	if(NULL==cigar.end){ cigar.end = elt; }
+	if(!reserve_CIGLIST(&cigar,cigar.nop+1)){ return cigar; }
+	CIGOP * op = ops_CIGLIST(&cigar);
+	memmove(op+1,op,cigar.nop*sizeof(CIGOP));
+	op[0] = (CIGOP){num,type};
+	cigar.nop++;
 	return cigar;
 }
 
 CIGLIST pushEnd_CIGLIST(CIGLIST cigar, const char type, const int num){
-        CIGELT elt = malloc(sizeof(*elt));
-        if(NULL==elt){ 
-		free_CIGLIST(cigar);
-		return null_CIGLIST;
-	}
-
-        elt->nxt = NULL;
-        elt->type = type;
-        elt->num = num;
-
-	if(NULL==cigar.end){
-		cigar.start = elt;
-		cigar.end = elt;
-	} else {
-		cigar.end->nxt = elt;
-		cigar.end = elt;
-	}
+	if(!reserve_CIGLIST(&cigar,cigar.nop+1)){ return cigar; }
+	ops_CIGLIST(&cigar)[cigar.nop++] = (CIGOP){num,type};
 	return cigar;
 }
 
 int strlen_CIGLIST(const CIGLIST cigar){
 	int elts = 0;
-	CIGELT elt = cigar.start;
-	while(NULL!=elt){
-		elts += ndigits(elt->num) + 1;
-		elt = elt->nxt;
+	for ( uint32_t i=0 ; i<cigar.nop ; i++){
+		elts += ndigits(get_CIGLIST(&cigar,i).num) + 1;
 	}
 	return elts;
 }
@@ -109,64 +132,86 @@ char * string_CIGLIST(const CIGLIST cigar){
 	int nelt = strlen_CIGLIST(cigar);
 	str = calloc(nelt+1,sizeof(char));
 
-	CIGELT elt = cigar.start;
 	char * strp = str;
-	while(NULL!=elt){
-		sprintf(strp,"%d%c",elt->num,elt->type);
-		strp += ndigits(elt->num) + 1;
-		elt = elt->nxt;
+	for ( uint32_t i=0 ; i<cigar.nop ; i++){
+		const CIGOP op = get_CIGLIST(&cigar,i);
+		sprintf(strp,"%u%c",op.num,op.type);
+		strp += ndigits(op.num) + 1;
 	}
 	return str;
 }
 
 void show_CIGLIST(FILE * fp, const CIGLIST cigar){
 	if(NULL==fp){ return; }
-	CIGELT elt = cigar.start;
-        while(NULL!=elt){
-		fprintf(fp,"%d%c",elt->num,elt->type);
-		elt = elt->nxt;
+	for ( uint32_t i=0 ; i<cigar.nop ; i++){
+		const CIGOP op = get_CIGLIST(&cigar,i);
+		fprintf(fp,"%u%c",op.num,op.type);
 	}
 }
 
 
-CIGLIST copy_CIGLIST(const CIGLIST cigar){
-	CIGLIST newcigar = {NULL,NULL};
-	CIGELT elt = cigar.start;
-
-	while(NULL!=elt){
-		newcigar = pushEnd_CIGLIST(newcigar,elt->type,elt->num);
-		elt = elt->nxt;
+/* Functions with the _ARENA suffix take storage from the arena, if not
+ * NULL, and the resulting list need not be passed to free_CIGLIST.
+ */
+CIGLIST copy_CIGLIST_ARENA(const CIGLIST cigar, ARENA arena){
+	CIGLIST newcig = null_CIGLIST;
+	CIGOP * op = alloc_CIGLIST(&newcig,cigar.nop,arena);
+	if(NULL==op){ return null_CIGLIST; }
+	for ( uint32_t i=0 ; i<cigar.nop ; i++){
+		op[i] = get_CIGLIST(&cigar,i);
 	}
-	return newcigar;
+	newcig.nop = cigar.nop;
+	return newcig;
+}
+
+CIGLIST copy_CIGLIST(const CIGLIST cigar){
+	return copy_CIGLIST_ARENA(cigar,NULL);
 }
 
 CIGLIST reverse_cigar(const CIGLIST cigar){
-	CIGLIST newcig = {NULL,NULL};
-	CIGELT elt = cigar.start;
-	while(NULL!=elt){
-		newcig = pushStart_CIGLIST(newcig,elt->type,elt->num);
-		elt = elt->nxt;
-	}
+	CIGLIST newcig = copy_CIGLIST(cigar);
+	newcig.reverse = true;
 	return newcig;
 }
 
+/* Reversed cigar sharing operations with the original, so only valid while
+ * it is. Need not be freed.
+ */
+CIGLIST reverse_cigar_view(const CIGLIST cigar){
+	CIGLIST view = cigar;
+	view.cap = 0;
+	view.reverse = !cigar.reverse;
+	return view;
+}
+
 CIGLIST sub_cigar(const CIGLIST cigar, const int len){
-	CIGLIST newcig = {NULL,NULL};
-	CIGELT elt = cigar.start;
-	int tot=0;
-	while(NULL!=elt && tot<len){
-		newcig = pushEnd_CIGLIST(newcig,elt->type,elt->num);
-		if('D'!=elt->type){tot += elt->num;}
-		elt = elt->nxt;
+	return sub_cigar_ARENA(cigar,len,NULL);
+}
+
+CIGLIST sub_cigar_ARENA(const CIGLIST cigar, const int len, ARENA arena){
+	// Operations needed to cover len bases
+	uint32_t nop = 0;
+	int tot = 0;
+	while(nop<cigar.nop && tot<len){
+		const CIGOP op = get_CIGLIST(&cigar,nop);
+		if('D'!=op.type){tot += op.num;}
+		nop++;
 	}
+	const bool pad = (tot<len);
 
-	if(tot<len){
+	CIGLIST newcig = null_CIGLIST;
+	CIGOP * op = alloc_CIGLIST(&newcig,nop+pad,arena);
+	if(NULL==op){ return null_CIGLIST; }
+	for ( uint32_t i=0 ; i<nop ; i++){
+		op[i] = get_CIGLIST(&cigar,i);
+	}
+	if(pad){
 		// Invalid shortening, pad with N's
-		newcig = pushEnd_CIGLIST(newcig,'N',len-tot);
+		op[nop] = (CIGOP){len-tot,'N'};
 	} else {
-		if(NULL!=newcig.end){newcig.end->num -= (tot-len);}
+		if(nop>0){op[nop-1].num -= (tot-len);}
 	}
-
+	newcig.nop = nop + pad;
 	return newcig;
 }
 
@@ -457,72 +502,147 @@ cleanup:
 }
 
 
-SEQ mutate_SEQ ( const SEQ seq, const real_t ins, const real_t del, const real_t mut ){
-    validate(NULL!=seq,NULL);
-    validate(isprob(ins),NULL);
-    validate(isprob(del),NULL);
-    validate(isprob(mut),NULL);
-    const real_t probs[4] = { ins, del, mut, 1.-ins-del-mut };
-    
-    SEQ mutseq = copy_SEQ(seq);
+EDITLIST new_EDITLIST(void){
+    EDITLIST edits = calloc(1,sizeof(*edits));
+    validate(NULL!=edits,NULL);
+    edits->cap = 16;
+    edits->edit = malloc(edits->cap*sizeof(EDIT));
+    if(NULL==edits->edit){ free(edits); return NULL; }
+    return edits;
+}
+
+void free_EDITLIST( EDITLIST edits){
+    validate(NULL!=edits,);
+    safe_free(edits->edit);
+    safe_free(edits);
+}
+
+static inline bool push_EDITLIST( EDITLIST edits, const uint32_t pos, const char type, const NUC base){
+    if(edits->nedit==edits->cap){
+        EDIT * edit = realloc(edits->edit,2*edits->cap*sizeof(EDIT));
+        if(NULL==edit){ return false; }
+        edits->edit = edit;
+        edits->cap *= 2;
+    }
+    edits->edit[edits->nedit++] = (EDIT){pos,type,base};
+    return true;
+}
+
+/* Each base of seq is independently inserted before, deleted, substituted or
+ * matched. Rather than choosing between these for every base, the length of
+ * the run of matches before the next edit is drawn from a geometric
+ * distribution and skipped over, so the cost scales with the number of
+ * edits rather than the length of the sequence.
+ * Any previous contents of edits are replaced.
+ */
+bool mutate_EDITLIST( EDITLIST edits, const NUC * seq, const uint32_t len, const real_t ins, const real_t del, const real_t mut){
+    validate(NULL!=edits,false);
+    validate(NULL!=seq || 0==len,false);
+    validate(isprob(ins),false);
+    validate(isprob(del),false);
+    validate(isprob(mut),false);
+    const real_t pedit = ins + del + mut;
+    validate(isprob(pedit),false);
+
+    edits->nedit = 0;
+    edits->srclen = len;
     uint32_t scount=0, mcount=0;
-    char cigType = 0; int cigNum = 0;
-    CIGLIST cigar = null_CIGLIST;
-    while(scount<seq->length){
-        if(mcount==mutseq->length){ // Enlarge mutated sequence
-            resize_SEQ(mutseq,mutseq->length*2);
+    while(scount<len){
+        // Run of matches, truncated at end of sequence
+        const uint32_t nmatch = rgeom(pedit);
+        if(nmatch>=len-scount){ mcount += len-scount; break; }
+        scount += nmatch; mcount += nmatch;
+
+        // Edit
+        bool ok;
+        const real_t u = pedit * runif();
+        if(u<ins){ // Insertion of base
+            ok = push_EDITLIST(edits,scount,'I',random_NUC());
+            mcount++;
+        } else if (u<ins+del){ // Deletion
+            ok = push_EDITLIST(edits,scount,'D',NUC_AMBIG);
+            scount++;
+        } else { // Mutation
+            ok = push_EDITLIST(edits,scount,'S',random_other_NUC(seq[scount]));
+            mcount++; scount++;
         }
-        uint32_t i = rchoose(probs,4);
-        switch(i){
-           case 0: // Insertion of base
-	       if('I'==cigType){ cigNum++;}
-	       else {
-		       if(0!=cigType){cigar = pushEnd_CIGLIST(cigar,cigType,cigNum);}
-		       cigType = 'I';
-		       cigNum = 1;
-	       }
-               mutseq->seq.elt[mcount] = random_NUC();
-               mcount++;
-               break;
-           case 1: // Deletion
-	       if('D'==cigType){ cigNum++;}
-	       else {
-		      if(0!=cigType){cigar = pushEnd_CIGLIST(cigar,cigType,cigNum);}
-		      cigType = 'D';
-		      cigNum = 1;
-	       } 
-               scount++;
-               break;
-           case 2: // Mutation
-	       if('S'==cigType){ cigNum++;}
-	       else {
-                      if(0!=cigType){cigar = pushEnd_CIGLIST(cigar,cigType,cigNum);}
-                      cigType = 'S';
-                      cigNum = 1;
-               }
-               mutseq->seq.elt[mcount] = random_other_NUC(seq->seq.elt[scount]);
-               mcount++; scount++;
-               break;
-           case 3: // Match
-	       if('M'==cigType){ cigNum++;}
-	       else {
-                      if(0!=cigType){cigar = pushEnd_CIGLIST(cigar,cigType,cigNum);}
-                      cigType = 'M';
-                      cigNum = 1;
-               }
-               mutseq->seq.elt[mcount] = seq->seq.elt[scount];
-               mcount++; scount++;
-               break;
-           default:
-               errx(EXIT_FAILURE,"Invalid case '%d' generated in %s (%s:%u)",i,__func__,__FILE__,__LINE__);
+        if(!ok){ return false; }
+    }
+    edits->length = mcount;
+    return true;
+}
+
+/* Write mutated sequence, of edits->length bases, into mutseq */
+void apply_EDITLIST( const EDITLIST edits, const NUC * seq, NUC * mutseq){
+    validate(NULL!=edits,);
+    uint32_t scount=0;
+    for ( uint32_t e=0 ; e<edits->nedit ; e++){
+        const EDIT edit = edits->edit[e];
+        const uint32_t nmatch = edit.pos - scount;
+        memcpy(mutseq,seq+scount,nmatch*sizeof(NUC));
+        mutseq += nmatch; scount += nmatch;
+        switch(edit.type){
+            case 'I': *mutseq++ = edit.base; break;
+            case 'D': scount++; break;
+            default:  *mutseq++ = edit.base; scount++;
         }
     }
+    memcpy(mutseq,seq+scount,(edits->srclen-scount)*sizeof(NUC));
+}
+
+/* Extend cigar by num operations of type, merging with any pending run */
+static inline CIGLIST push_edit( CIGLIST cigar, char * cigType, int * cigNum, const char type, const int num){
+    if(type==*cigType){ *cigNum += num; return cigar; }
+    if(0!=*cigType){ cigar = pushEnd_CIGLIST(cigar,*cigType,*cigNum); }
+    *cigType = type;
+    *cigNum = num;
+    return cigar;
+}
+
+/* Cigar describing mutated sequence relative to original, without leading
+ * or trailing deletions.
+ */
+CIGLIST cigar_EDITLIST( const EDITLIST edits){
+    validate(NULL!=edits,null_CIGLIST);
+    char cigType = 0; int cigNum = 0;
+    CIGLIST cigar = null_CIGLIST;
+    uint32_t scount=0;
+    for ( uint32_t e=0 ; e<edits->nedit ; e++){
+        const EDIT edit = edits->edit[e];
+        if(edit.pos>scount){ cigar = push_edit(cigar,&cigType,&cigNum,'M',edit.pos-scount); }
+        cigar = push_edit(cigar,&cigType,&cigNum,edit.type,1);
+        scount = edit.pos + ('I'!=edit.type);
+    }
+    if(edits->srclen>scount){ cigar = push_edit(cigar,&cigType,&cigNum,'M',edits->srclen-scount); }
     // Push any remaining edits into cigar string, except deletions.
     if(0!=cigType && 'D'!=cigType){cigar = pushEnd_CIGLIST(cigar,cigType,cigNum);}
-    cigar = compact_CIGLIST(cigar);
-    mutseq = resize_SEQ(mutseq,mcount);
+    return compact_CIGLIST(cigar);
+}
+
+SEQ mutate_SEQ ( const SEQ seq, const real_t ins, const real_t del, const real_t mut ){
+    validate(NULL!=seq,NULL);
+    EDITLIST edits = new_EDITLIST();
+    validate(NULL!=edits,NULL);
+    SEQ mutseq = NULL;
+    if(!mutate_EDITLIST(edits,seq->seq.elt,seq->length,ins,del,mut)){ goto cleanup; }
+
+    // Qualities are kept by position, padded if sequence has grown
+    mutseq = copy_SEQ(seq);
+    if(NULL==mutseq){ goto cleanup; }
+    if(edits->length>mutseq->length){ mutseq = resize_SEQ(mutseq,edits->length); }
+    if(NULL==mutseq){ goto cleanup; }
+    apply_EDITLIST(edits,seq->seq.elt,mutseq->seq.elt);
+    if(0==edits->length){ // Everything deleted; can't resize to nothing
+        mutseq->length = 0;
+    } else {
+        mutseq = resize_SEQ(mutseq,edits->length);
+        if(NULL==mutseq){ goto cleanup; }
+    }
     free_CIGLIST(mutseq->cigar);
-    mutseq->cigar = cigar;
+    mutseq->cigar = cigar_EDITLIST(edits);
+
+cleanup:
+    free_EDITLIST(edits);
     return mutseq;
 }
 
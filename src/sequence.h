@@ -27,25 +27,48 @@
 #include <stdio.h>
 #include "nuc.h"
 #include "utility.h"
+#include "arena.h"
 
-typedef struct _cigelt {
+/* Cigar strings are arrays of operations, stored inline when short so that
+ * the typical read or fragment needs no allocation. Longer arrays are held
+ * in "op", which is owned by the list if "cap" is non-zero and otherwise
+ * borrowed from an arena or another list (a view). Operations are read in
+ * reverse order of storage if "reverse" is set.
+ */
+#define CIGLIST_INLINE 6
+
+typedef struct {
+	uint32_t num;
 	char type;
-	int num;
-	struct _cigelt * nxt;
-} * CIGELT;
+} CIGOP;
 
 typedef struct _ciglist {
-	CIGELT start, end;
+	CIGOP * op;
+	uint32_t nop, cap;
+	bool reverse;
+	CIGOP inline_op[CIGLIST_INLINE];
 } CIGLIST;
 
-static CIGLIST null_CIGLIST __attribute__((unused)) = {NULL,NULL};
+static CIGLIST null_CIGLIST __attribute__((unused)) = {0};
+
+/* Operation i of cigar, in order */
+static inline CIGOP get_CIGLIST(const CIGLIST * cigar, const uint32_t i){
+	const CIGOP * op = (NULL!=cigar->op)?cigar->op:cigar->inline_op;
+	return op[cigar->reverse?(cigar->nop-1-i):i];
+}
 
 void show_CIGLIST(FILE * fp, const CIGLIST cigar);
 char * string_CIGLIST(const CIGLIST cigar);
 CIGLIST copy_CIGLIST(const CIGLIST cigar);
 void free_CIGLIST(CIGLIST cigar);
+CIGLIST pushStart_CIGLIST(CIGLIST cigar, const char type, const int num);
+CIGLIST pushEnd_CIGLIST(CIGLIST cigar, const char type, const int num);
+CIGLIST compact_CIGLIST(CIGLIST cigar);
 CIGLIST sub_cigar(const CIGLIST cigar, const int len);
 CIGLIST reverse_cigar(const CIGLIST cigar);
+CIGLIST reverse_cigar_view(const CIGLIST cigar);
+CIGLIST copy_CIGLIST_ARENA(const CIGLIST cigar, ARENA arena);
+CIGLIST sub_cigar_ARENA(const CIGLIST cigar, const int len, ARENA arena);
 
 
 struct _sequence {
@@ -63,6 +86,7 @@ SEQ new_SEQ(const uint32_t len, const bool has_qual);
 SEQ sequence_from_str( const char * restrict name, const char * restrict seqstr, const char * qname, const char * restrict qualstr );
 SEQ copy_SEQ( const SEQ seq);
 void show_SEQ(FILE * fp, const SEQ seq, CSTRING fmt);
+bool hasQual( const SEQ seq);
 
 // Creating
 SEQ sequence_from_file  ( FILE * fp);
@@ -73,5 +97,28 @@ SEQ sequence_from_fastq ( FILE * fp);
 SEQ reverse_complement_SEQ( const SEQ seq, const bool revcigar);
 SEQ mutate_SEQ( const SEQ seq, const real_t ins, const real_t del, const real_t mut );
 SEQ sub_SEQ( const SEQ seq, const uint32_t loc, const uint32_t len);
+
+/* Edits made to a sequence of srclen bases by mutation, in order of
+ * position. An insertion is made before the base at pos; consecutive
+ * insertions at the same position are in order. The mutated sequence has
+ * length bases.
+ */
+typedef struct {
+    uint32_t pos;
+    char type;      // 'I', 'D' or 'S'
+    NUC base;       // Base inserted or substituted
+} EDIT;
+
+typedef struct {
+    EDIT * edit;
+    uint32_t nedit, cap;
+    uint32_t srclen, length;
+} * EDITLIST;
+
+EDITLIST new_EDITLIST(void);
+void free_EDITLIST( EDITLIST edits);
+bool mutate_EDITLIST( EDITLIST edits, const NUC * seq, const uint32_t len, const real_t ins, const real_t del, const real_t mut);
+void apply_EDITLIST( const EDITLIST edits, const NUC * seq, NUC * mutseq);
+CIGLIST cigar_EDITLIST( const EDITLIST edits);
 #endif
 
@@ -29,6 +29,7 @@
 #include <ctype.h>
 #include <math.h>
 #include "sequence.h"
+#include "seqreader.h"
 #include "random.h"
 #include "utility.h"
 #include "intensities.h"
@@ -36,6 +37,11 @@
 #include "normal.h"
 #include "kumaraswamy.h"
 #include "lambda_distribution.h"
+#include "pool.h"
+#include "outbuf.h"
+#include "asyncout.h"
+#include "binformat.h"
+#include "library.h"
 
 #define Q_(A) #A
 #define QUOTE(A) Q_(A)
@@ -44,6 +50,9 @@
 #define ILLUMINA_ADAPTER "AGATCGGAAGAGCGGTTCAGCAGGAATGCCGAGACCGAT"
 #define PROGNAME "simNGS"
 #define PROGVERSION "1.7"
+#define ARENA_BLOCKSIZE 65536
+#define JOB_OUTBUF_SIZE 4096
+#define OUTPUT_BLOCKSIZE (1<<20)
 
 enum paired_type { PAIRED_TYPE_SINGLE=0, PAIRED_TYPE_CYCLE, PAIRED_TYPE_PAIRED };
 char * paired_type_str[] = {"single","cycle","paired"};
@@ -69,24 +78,17 @@ typedef struct{
     ARRAY(NUC) seq, rcseq;
     MAT int1,int2;
     CIGLIST cigar1,cigar2;
+    uint64_t idx;
+    ARENA arena;    // Storage for read, including this structure
 } * SEQSTR;
 
+// Substreams of counter generator used for each read, below RNG_SUB_LIBRARY
+enum { RNG_SUB_READ=0, RNG_SUB_END1, RNG_SUB_END2, RNG_SUB_PLACE };
+
 MAT reverse_complement_MAT(const MAT mat);
 CALLED reverse_complement_CALLED( const CALLED called);
 void free_CALLED(CALLED called);
 
-void free_SEQSTR( SEQSTR seqstr){
-    if(NULL==seqstr){ return;}
-    free_MAT(seqstr->int1);
-    free_MAT(seqstr->int2);
-    free_CSTRING(seqstr->name);
-    free_ARRAY(NUC)(seqstr->seq);
-    free_ARRAY(NUC)(seqstr->rcseq);
-    free_CIGLIST(seqstr->cigar1);
-    free_CIGLIST(seqstr->cigar2);
-    free(seqstr);
-}
-
 void show_SEQSTR(FILE * fp, const SEQSTR seqstr){
     if(NULL==fp){return;}
     if(NULL==seqstr){ return;}
@@ -120,6 +122,12 @@ void fprint_usage( FILE * fp){
 "\t       [-F factor] [-g prob] [-i filename] [-I] [-j range:a:b] [-l lane]\n"
 "\t       [-N noise file] [-n ncycle] [-o output_format] [-O outfile_prefix]\n"
 "\t       [-p option] [-q quantile] [-r mu] [-R] [-s seed] [-t tile] [-v factor ]\n"
+"\t       [-z]\n"
+"\t       [--check-likelihood] [--compile-runfile filename]\n"
+"\t       [--intensity-format format]\n"
+"\t       [--library \"options\"] [--likelihood-format format]\n"
+"\t       [--output-stats]\n"
+"\t       [--rng generator] [--threads nthread]\n"
 "\t       runfile [seq.fa ... ]\n"
 "\t" PROGNAME " --help\n"
 "\t" PROGNAME " --licence\n"
@@ -131,6 +139,7 @@ void fprint_usage( FILE * fp){
 "Example:\n"
 "\tcat sequences.fa | " PROGNAME " runfile > sequences.fq\n"
 "\t" PROGNAME " runfile seq1.fa seq2.fa > sequences.fq\n"
+"\t" PROGNAME " --library \"--seed 1 -n 100000\" runfile genome.fa > sequences.fq\n"
 ,fp);
 }
 
@@ -176,6 +185,16 @@ void fprint_help( FILE * fp){
 "end will be repeated if necessary.\n"
 "Currently a Weibull distribution is used.\n"
 "\n"
+"--check-likelihood\n"
+"\tCompare every likelihood against the slower calculation that evaluates\n"
+"the quadratic form separately for each base, warning of any differences.\n"
+"\n"
+"--compile-runfile filename\n"
+"\tWrite runfile in a compiled binary form to filename and exit. Compiled\n"
+"runfiles are used in place of the text runfile and load far faster, with\n"
+"the factorisations of the covariance matrices already done. They are\n"
+"specific to the machine and build of simNGS that wrote them.\n"
+"\n"
 "-c, --correlation [default: 1.0]\n"
 "\tCorrelation between the cluster brightness of one end of a paired-end\n"
 "run and the other. Default is complete correlation, the ends having equal\n"
@@ -205,6 +224,18 @@ void fprint_help( FILE * fp){
 "-i, --intensities filename [default: none]\n"
 "\tWrite the processed intensities generated to \"filename\".\n"
 "\n"
+"--intensity-format format [default: text]\n"
+"\tFormat of intensities written by --intensities, either \"text\" or\n"
+"\"binary\". Binary files hold single precision values in fixed size\n"
+"records and are converted to text by simNGSconvert.\n"
+"\n"
+"--likelihood-format format [default: text]\n"
+"\tFormat of likelihoods written by \"-o likelihood\", either \"text\" or\n"
+"\"binary[:bits[:step]]\". Binary files store the call for each cycle and\n"
+"differences of -log-likelihood from it quantised to 8 or 16 bits with\n"
+"resolution step [default 8 bits, step 0.1 (16 bits, 0.001)], and are\n"
+"converted to text by simNGSconvert.\n"
+"\n"
 "-I, --illumina\n"
 "\tProduce Illumina scaled quality values where required. Ascii\n"
 "representation of quality value is ascii(quality+64) rather than the more\n"
@@ -221,6 +252,14 @@ void fprint_help( FILE * fp){
 "-l, --lane lane [default: as runfile]\n"
 "\tSet lane number\n"
 "\n"
+"--library \"options\" [default: none]\n"
+"\tSample a library of fragments from the sequences given, using simLibrary\n"
+"with options (separated by spaces, quoted as one argument), and simulate reads\n"
+"from the fragments without writing them out. Fragments are sampled on separate\n"
+"threads, --threads within options setting how many, and are passed straight\n"
+"to simulation. Reads are the same as simulated from the output of\n"
+"\"simLibrary options\" with the same seeds.\n"
+"\n"
 "-M, --matrix filename [default: none]\n"
 "\tFile to read cross-talk matrix from. Not required for general\n"
 "simulation of sequence and qualities.\n"
@@ -241,6 +280,11 @@ void fprint_help( FILE * fp){
 "reads and \"paired\" is set, each end is writen to a separate file. By\n"
 "default, ends are intermingled and written to stdout.\n"
 "\n"
+"--output-stats\n"
+"\tReport how often simulation waited for output to be written, and how\n"
+"often output waited for simulation, to show whether a run is limited by\n"
+"output or by computation.\n"
+"\n"
 "-p, --paired option [default: single]\n"
 "\tTreat run as paired-end.\n"
 "Valid options are: \"single\", \"paired\", \"cycle\".\n"
@@ -263,14 +307,33 @@ void fprint_help( FILE * fp){
 "-R, --raw\n"
 "\tDump raw intensities rather than processed intensities.\n"
 "\n"
+"--rng generator [default: sfmt]\n"
+"\tRandom number generator to use, either \"sfmt\" or \"counter\". The sfmt\n"
+"generator is a single stream shared by all reads. The counter generator gives\n"
+"each read its own streams, keyed by the seed and the position of the read in\n"
+"the input, so a read can be regenerated independently of those before it.\n"
+"Intensities are then generated by the worker threads and output does not\n"
+"depend on the number of threads.\n"
+"\n"
 "-s, --seed seed [default: clock]\n"
 "\tSet seed from random number generator.\n"
 "\n"
 "-t, --tile tile [default: as runfile\n"
 "\tSet tile number.\n"
 "\n"
+"--threads nthread [default: 1]\n"
+"\tNumber of threads to use for calling reads. Sequences are read and\n"
+"intensities generated on the main thread, calling is spread over <nthread>\n"
+"worker threads and results are written in the order sequences were read.\n"
+"Output is identical to that of a single threaded run with the same seed.\n"
+"\n"
 "-v, --variance factor [default: 1.0]\n"
 "\tFactor with which to scale variance matrix by.\n"
+"\n"
+"-z, --gzip\n"
+"\tCompress all output, including intensities, in BGZF format: gzip\n"
+"compatible and indexable. Output files named using --outfile have \".gz\"\n"
+"appended. Compression uses one thread per processor.\n"
 , fp);
 }
 
@@ -299,7 +362,16 @@ static struct option longopts[] = {
     { "raw",        no_argument,       NULL, 'R' },
     { "seed",       required_argument, NULL, 's' },
     { "tile",       required_argument, NULL, 't' },
+    { "rng",        required_argument, NULL, 3 },
+    { "check-likelihood", no_argument, NULL, 4 },
+    { "output-stats", no_argument,     NULL, 5 },
+    { "intensity-format", required_argument, NULL, 6 },
+    { "likelihood-format", required_argument, NULL, 7 },
+    { "compile-runfile", required_argument, NULL, 8 },
+    { "threads",    required_argument, NULL, 2 },
+    { "library",    required_argument, NULL, 9 },
     { "variance",   required_argument, NULL, 'v' },
+    { "gzip",       no_argument,       NULL, 'z' },
     { "help",       no_argument,       NULL, 'h' },
     { "licence",    no_argument,       NULL, 0 },
     { "license",    no_argument,       NULL, 0 },
@@ -350,6 +422,8 @@ typedef struct {
     real_t purity_threshold;
     uint32_t purity_cycles,purity_max;
     CSTRING intensity_fn;
+    CSTRING compile_fn;
+    CSTRING library;
     enum outformat format;
     bool jumble;
     uint32_t bufflen;
@@ -362,6 +436,14 @@ typedef struct {
     bool illumina,dumpRaw;
     char * outprefix;
     FILE * outfp[2];
+    uint32_t nthread;
+    enum rngtype rng;
+    bool check_likelihood;
+    bool output_stats;
+    bool gzip;
+    bool binary_intensities;
+    uint32_t like_bits;
+    real_t like_step;
 } * SIMOPT;
 
 SIMOPT new_SIMOPT(void){
@@ -386,6 +468,8 @@ SIMOPT new_SIMOPT(void){
     opt->purity_cycles = 0;
     opt->purity_max = 0;
     opt->intensity_fn = NULL;
+    opt->compile_fn = NULL;
+    opt->library = NULL;
     opt->format = OUTPUT_FASTQ;
     opt->jumble = false;
     opt->bufflen = 1; opt->a=0.; opt->b=0;
@@ -400,12 +484,22 @@ SIMOPT new_SIMOPT(void){
     opt->outprefix = NULL;
     opt->outfp[0] = stdout;
     opt->outfp[1] = stdout;
+    opt->nthread = 1;
+    opt->rng = RNG_SFMT;
+    opt->check_likelihood = false;
+    opt->output_stats = false;
+    opt->gzip = false;
+    opt->binary_intensities = false;
+    opt->like_bits = 0;
+    opt->like_step = 0.;
     return opt;
 }
 
 void free_SIMOPT(SIMOPT opt){
     validate(NULL!=opt,);
     free(opt->intensity_fn);
+    free(opt->compile_fn);
+    free(opt->library);
     free_ARRAY(NUC)(opt->adapter1);
     free_ARRAY(NUC)(opt->adapter2);
     safe_free(opt);
@@ -419,6 +513,12 @@ SIMOPT copy_SIMOPT ( const SIMOPT simopt){
     if(NULL!=simopt->intensity_fn){
         newopt->intensity_fn = copy_CSTRING(simopt->intensity_fn);
     }
+    if(NULL!=simopt->compile_fn){
+        newopt->compile_fn = copy_CSTRING(simopt->compile_fn);
+    }
+    if(NULL!=simopt->library){
+        newopt->library = copy_CSTRING(simopt->library);
+    }
     return newopt;
 }
 
@@ -436,6 +536,8 @@ void show_SIMOPT (FILE * fp, const SIMOPT simopt){
     fprintf( fp,"variance factor\t%f\n",simopt->sdfact*simopt->sdfact);
     fprintf( fp,"tile\t%u\tlane%u\n",simopt->tile,simopt->lane);
     fprintf( fp,"seed\t%u\n",simopt->seed);
+    fprintf( fp,"threads\t%u\n",simopt->nthread);
+    fprintf( fp,"generator\t%s\n",rngtype_str[simopt->rng]);
 
     if(simopt->purity_cycles!=0){
        fprintf( fp,"Purity filtering: threshold %f. Maximum of %u inpure in %u cycles\n",simopt->purity_threshold, simopt->purity_max,simopt->purity_cycles);
@@ -464,7 +566,7 @@ SIMOPT parse_arguments( const int argc, char * const argv[] ){
     SIMOPT simopt = new_SIMOPT();
     validate(NULL!=simopt,NULL);
     
-    while ((ch = getopt_long(argc, argv, "a:A:b:c:dD:F:f:g:i:Ij:l:M:n:N:o:O:p:P:q:r:Rs:t:uv:h", longopts, NULL)) != -1){
+    while ((ch = getopt_long(argc, argv, "a:A:b:c:dD:F:f:g:i:Ij:l:M:n:N:o:O:p:P:q:r:Rs:t:uv:zh", longopts, NULL)) != -1){
         int ret=0;
         unsigned long int i=0,j=0;
 	real_t param1[2],param2[2];
@@ -598,6 +700,48 @@ fprintf(stderr,"Copying adapter\n");
         case 't':   simopt->tile = parse_uint(optarg);
                     if(simopt->tile==0){errx(EXIT_FAILURE,"Tile number must be greater than zero.");}
                     break;
+        case 2:     simopt->nthread = parse_uint(optarg);
+                    if(simopt->nthread==0){errx(EXIT_FAILURE,"Number of threads must be greater than zero.");}
+                    break;
+        case 3:     if( strcasecmp(optarg,rngtype_str[RNG_SFMT])==0 ){ simopt->rng = RNG_SFMT; }
+                    else if ( strcasecmp(optarg,rngtype_str[RNG_COUNTER])==0 ){ simopt->rng = RNG_COUNTER; }
+                    else {
+                        errx(EXIT_FAILURE,"Unrecognised random number generator %s.",optarg);
+                    }
+                    break;
+        case 4:     simopt->check_likelihood = true;
+                    break;
+        case 5:     simopt->output_stats = true;
+                    break;
+        case 'z':   simopt->gzip = true;
+                    break;
+        case 6:     if( strcasecmp(optarg,"text")==0 ){ simopt->binary_intensities = false; }
+                    else if ( strcasecmp(optarg,"binary")==0 ){ simopt->binary_intensities = true; }
+                    else {
+                        errx(EXIT_FAILURE,"Unrecognised intensity format %s.",optarg);
+                    }
+                    break;
+        case 7:     if( strcasecmp(optarg,"text")==0 ){ simopt->like_bits = 0; break; }
+                    if( strncasecmp(optarg,"binary",6)!=0 || (optarg[6]!='\0' && optarg[6]!=':') ){
+                        errx(EXIT_FAILURE,"Unrecognised likelihood format %s.",optarg);
+                    }
+                    simopt->like_bits = 8;
+                    simopt->like_step = 0.;
+                    if(optarg[6]==':'){
+                        ret = sscanf(optarg+7,"%lu:" real_format_str,&i,&param1[0]);
+                        if(ret<1 || (i!=8 && i!=16)){ errx(EXIT_FAILURE,"Bits per likelihood must be 8 or 16 (got %s).",optarg+7); }
+                        simopt->like_bits = i;
+                        if(ret==2){
+                            if(param1[0]<=0.){ errx(EXIT_FAILURE,"Step for quantised likelihoods must be greater than zero."); }
+                            simopt->like_step = param1[0];
+                        }
+                    }
+                    if(simopt->like_step==0.){ simopt->like_step = (8==simopt->like_bits)?0.1:0.001; }
+                    break;
+        case 8:     simopt->compile_fn = copy_CSTRING(optarg);
+                    break;
+        case 9:     simopt->library = copy_CSTRING(optarg);
+                    break;
         case 'v':   simopt->sdfact = parse_real(optarg);
                     if(simopt->sdfact<0.0){errx(EXIT_FAILURE,"Variance scaling factor must be non-negative.");}
                     simopt->sdfact = sqrt(simopt->sdfact);
@@ -644,79 +788,117 @@ static inline real_t prop_lower( const real_t p, const uint32_t n){
     return desc / (1.0 + z*z/n);
 }
 
-void output_likelihood_sub(FILE * fp, const SIMOPT simopt, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
+/* Tab separated values for each cycle, same format as fprint_intensities */
+static void append_intensities(OUTBUF out, const MAT ints){
+    validate(NULL!=ints,);
+    validate(NBASE==ints->nrow,);
+    for ( uint32_t i=0 ; i<NBASE*ints->ncol ; i++){
+        append_char_OUTBUF(out,(i%NBASE)?' ':'\t');
+        append_real_OUTBUF(out,ints->x[i]);
+    }
+}
+
+static void append_location(OUTBUF out, const SIMOPT simopt, const uint32_t x, const uint32_t y){
+    append_uint_OUTBUF(out,simopt->lane); append_char_OUTBUF(out,'\t');
+    append_uint_OUTBUF(out,simopt->tile); append_char_OUTBUF(out,'\t');
+    append_uint_OUTBUF(out,x); append_char_OUTBUF(out,'\t');
+    append_uint_OUTBUF(out,y);
+}
+
+void output_likelihood_sub(OUTBUF out, const SIMOPT simopt, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
     const bool has_called2 = (called2!=NULL);
-    fprintf(fp,"%u\t%u\t%u\t%u",simopt->lane,simopt->tile,x,y);
+    append_location(out,simopt,x,y);
     if(called1->pass_filter){
-        fprint_intensities(fp,"",called1->loglike,false);
-        if(has_called2){fprint_intensities(fp,"",called2->loglike,false);}
+        append_intensities(out,called1->loglike);
+        if(has_called2){append_intensities(out,called2->loglike);}
     }
-    fputc('\n',fp);
+    append_char_OUTBUF(out,'\n');
 }
 
-void output_likelihood(const SIMOPT simopt, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
+/* Binary likelihoods. Ends that text output writes as separate lines are
+ * separate records, consecutive if written to the same file.
+ */
+void output_binary_likelihood(OUTBUF const outfp[2], const SIMOPT simopt, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
+	if(PAIRED_TYPE_PAIRED==simopt->paired){
+		append_likelihoods_BINFORMAT(outfp[0],simopt->like_bits,simopt->like_step,x,y,called1->pass_filter,0,called1->loglike,NULL);
+		append_likelihoods_BINFORMAT(outfp[1],simopt->like_bits,simopt->like_step,x,y,called2->pass_filter,1,called2->loglike,NULL);
+	} else {
+		append_likelihoods_BINFORMAT(outfp[0],simopt->like_bits,simopt->like_step,x,y,called1->pass_filter,0,called1->loglike,(NULL!=called2)?called2->loglike:NULL);
+	}
+}
+
+void output_likelihood(OUTBUF const outfp[2], const SIMOPT simopt, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
+	if(0!=simopt->like_bits){
+		output_binary_likelihood(outfp,simopt,x,y,called1,called2);
+		return;
+	}
 	switch(simopt->paired){
 	case PAIRED_TYPE_SINGLE:
 	case PAIRED_TYPE_CYCLE:
-		output_likelihood_sub(simopt->outfp[0],simopt,x,y,called1,called2);
+		output_likelihood_sub(outfp[0],simopt,x,y,called1,called2);
 		break;
 	case PAIRED_TYPE_PAIRED:
-		output_likelihood_sub(simopt->outfp[0],simopt,x,y,called1,NULL);
-		output_likelihood_sub(simopt->outfp[1],simopt,x,y,called2,NULL);
+		output_likelihood_sub(outfp[0],simopt,x,y,called1,NULL);
+		output_likelihood_sub(outfp[1],simopt,x,y,called2,NULL);
 		break;
 	default:
 		errx(EXIT_FAILURE,"Unrecognised case %s (%s:%d)",__func__,__FILE__,__LINE__);
 	}	
 }
 
-void output_fasta_sub(FILE * fp, const SIMOPT simopt, const char * seqname, const CIGLIST cigar, const char * suffix, const CALLED called1, const CALLED called2){
+static void append_header(OUTBUF out, const char start, const char * seqname, const CIGLIST cigar, const char * suffix){
+    append_char_OUTBUF(out,start);
+    append_cstring_OUTBUF(out,seqname);
+    append_cstring_OUTBUF(out,suffix);
+    append_char_OUTBUF(out,' ');
+    append_CIGLIST_OUTBUF(out,cigar);
+    append_char_OUTBUF(out,'\n');
+}
+
+void output_fasta_sub(OUTBUF out, const SIMOPT simopt, const char * seqname, const CIGLIST cigar, const char * suffix, const CALLED called1, const CALLED called2){
     const bool has_called2 = (called2!=NULL);
-    fprintf(fp,">%s%s ",seqname,suffix);
-    show_CIGLIST(fp,cigar);
-    fputc('\n',fp);
+    append_header(out,'>',seqname,cigar,suffix);
     if(called1->pass_filter){
-        show_ARRAY(NUC)(fp,called1->calls,"",0);
-        if(has_called2){ show_ARRAY(NUC)(fp,called2->calls,"",0);}
+        append_NUC_OUTBUF(out,called1->calls);
+        if(has_called2){ append_NUC_OUTBUF(out,called2->calls);}
     } else {
-        show_ARRAY(NUC)(fp,ambigseq,"",0);
-        if(has_called2){ show_ARRAY(NUC)(fp,ambigseq,"",0);}
+        append_NUC_OUTBUF(out,ambigseq);
+        if(has_called2){ append_NUC_OUTBUF(out,ambigseq);}
     }
-    fputc('\n',fp);
+    append_char_OUTBUF(out,'\n');
 }
 
-void output_fastq_sub(FILE * fp, const SIMOPT simopt, const char * seqname, const CIGLIST cigar, const char * suffix, const CALLED called1, const CALLED called2){
+void output_fastq_sub(OUTBUF out, const SIMOPT simopt, const char * seqname, const CIGLIST cigar, const char * suffix, const CALLED called1, const CALLED called2){
     const bool has_called2 = (called2!=NULL);
-    fprintf(fp,"@%s%s ",seqname,suffix);
-    show_CIGLIST(fp,cigar);
-    fputc('\n',fp);
+    append_header(out,'@',seqname,cigar,suffix);
     if(called1->pass_filter){
-        show_ARRAY(NUC)(fp,called1->calls,"",0);
-        if(has_called2){ show_ARRAY(NUC)(fp,called2->calls,"",0);}
+        append_NUC_OUTBUF(out,called1->calls);
+        if(has_called2){ append_NUC_OUTBUF(out,called2->calls);}
     } else {
-        show_ARRAY(NUC)(fp,ambigseq,"",0);
-        if(has_called2){ show_ARRAY(NUC)(fp,ambigseq,"",0);}
+        append_NUC_OUTBUF(out,ambigseq);
+        if(has_called2){ append_NUC_OUTBUF(out,ambigseq);}
     }
-    fputs("\n+\n",fp);
+    append_OUTBUF(out,"\n+\n",3);
     if(called1->pass_filter){
-        show_ARRAY(PHREDCHAR)(fp,called1->quals,"",0);
-        if(has_called2){ show_ARRAY(PHREDCHAR)(fp,called2->quals,"",0);}
+        append_PHREDCHAR_OUTBUF(out,called1->quals);
+        if(has_called2){ append_PHREDCHAR_OUTBUF(out,called2->quals);}
     } else {
-        show_ARRAY(PHREDCHAR)(fp,ambigphred,"",0);
-        if(has_called2){ show_ARRAY(PHREDCHAR)(fp,ambigphred,"",0);}
+        append_PHREDCHAR_OUTBUF(out,ambigphred);
+        if(has_called2){ append_PHREDCHAR_OUTBUF(out,ambigphred);}
     }
-    fputc('\n',fp);
+    append_char_OUTBUF(out,'\n');
 }
 
-void output_fasta(const SIMOPT simopt, const char * seqname, const CIGLIST cigar1, const CIGLIST cigar2, const CALLED called1, const CALLED called2){
-	const bool use_suff = (simopt->outfp[0]==simopt->outfp[1]);
+void output_fasta(OUTBUF const outfp[2], const SIMOPT simopt, const char * seqname, const CIGLIST cigar1, const CIGLIST cigar2, const CALLED called1, const CALLED called2){
+	const bool use_suff = (outfp[0]==outfp[1]);
         switch(simopt->paired){
         case PAIRED_TYPE_SINGLE:
         case PAIRED_TYPE_CYCLE:
-                output_fasta_sub(simopt->outfp[0],simopt,seqname,cigar1,"",called1,called2);
+                output_fasta_sub(outfp[0],simopt,seqname,cigar1,"",called1,called2);
                 break;
         case PAIRED_TYPE_PAIRED:
-                output_fasta_sub(simopt->outfp[0],simopt,seqname,cigar1,use_suff?"/1":"",called1,NULL);
-                output_fasta_sub(simopt->outfp[1],simopt,seqname,cigar2,use_suff?"/2":"",called2,NULL);
+                output_fasta_sub(outfp[0],simopt,seqname,cigar1,use_suff?"/1":"",called1,NULL);
+                output_fasta_sub(outfp[1],simopt,seqname,cigar2,use_suff?"/2":"",called2,NULL);
                 break;
         default:
                 errx(EXIT_FAILURE,"Unrecognised case %s (%s:%d)",__func__,__FILE__,__LINE__);
@@ -725,21 +907,21 @@ void output_fasta(const SIMOPT simopt, const char * seqname, const CIGLIST cigar
 
 
 
-void output_fastq(const SIMOPT simopt, const char * seqname, const CIGLIST cigar1, const CIGLIST cigar2, const CALLED called1, const CALLED called2){
-	const bool use_suff = (simopt->outfp[0]==simopt->outfp[1]);
+void output_fastq(OUTBUF const outfp[2], const SIMOPT simopt, const char * seqname, const CIGLIST cigar1, const CIGLIST cigar2, const CALLED called1, const CALLED called2){
+	const bool use_suff = (outfp[0]==outfp[1]);
 	switch(simopt->paired){
 	case PAIRED_TYPE_SINGLE:
         case PAIRED_TYPE_CYCLE:
-		output_fastq_sub(simopt->outfp[0],simopt,seqname,cigar1,"",called1,called2);
+		output_fastq_sub(outfp[0],simopt,seqname,cigar1,"",called1,called2);
 		break;
 	case PAIRED_TYPE_PAIRED:
                 if (simopt->format == OUTPUT_CASAVA) {
-                    output_fastq_sub(simopt->outfp[0],simopt,seqname,null_CIGLIST,"",called1,NULL);
-                    output_fastq_sub(simopt->outfp[1],simopt,seqname,null_CIGLIST,"",called2,NULL);
+                    output_fastq_sub(outfp[0],simopt,seqname,null_CIGLIST,"",called1,NULL);
+                    output_fastq_sub(outfp[1],simopt,seqname,null_CIGLIST,"",called2,NULL);
                 }
                 else {
-		    output_fastq_sub(simopt->outfp[0],simopt,seqname,cigar1,use_suff?"/1":"",called1,NULL);
-		    output_fastq_sub(simopt->outfp[1],simopt,seqname,cigar2,use_suff?"/2":"",called2,NULL);
+		    output_fastq_sub(outfp[0],simopt,seqname,cigar1,use_suff?"/1":"",called1,NULL);
+		    output_fastq_sub(outfp[1],simopt,seqname,cigar2,use_suff?"/2":"",called2,NULL);
                 }
 		break;
 	default:
@@ -747,28 +929,30 @@ void output_fastq(const SIMOPT simopt, const char * seqname, const CIGLIST cigar
 	}
 }
 
-void output_results(FILE * intout, const SIMOPT simopt, const char * seqname, const CIGLIST cigar1, const CIGLIST cigar2, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
+void output_results(OUTBUF intout, OUTBUF const outfp[2], const SIMOPT simopt, const char * seqname, const CIGLIST cigar1, const CIGLIST cigar2, const uint32_t x, const uint32_t y, const CALLED called1, const CALLED called2){
     // Output raw intensities if required
-    if(NULL!=intout){
-        fprintf(intout,"%u\t%u\t%u\t%u",simopt->lane,simopt->tile,x,y);
-        fprint_intensities(intout,"",called1->intensities,false);
-        if(NULL!=called2){fprint_intensities(intout,"",called2->intensities,false);}
-        fputc('\n',intout);
+    if(NULL!=intout && simopt->binary_intensities){
+        append_intensities_BINFORMAT(intout,x,y,called1->intensities,(NULL!=called2)?called2->intensities:NULL);
+    } else if(NULL!=intout){
+        append_location(intout,simopt,x,y);
+        append_intensities(intout,called1->intensities);
+        if(NULL!=called2){append_intensities(intout,called2->intensities);}
+        append_char_OUTBUF(intout,'\n');
     }
 
     // Output in format requested
     switch(simopt->format){
        case OUTPUT_LIKE:
-           output_likelihood(simopt,x,y,called1,called2);
+           output_likelihood(outfp,simopt,x,y,called1,called2);
            break;
        case OUTPUT_FASTA:
-           output_fasta(simopt,seqname,cigar1,cigar2,called1,called2);
+           output_fasta(outfp,simopt,seqname,cigar1,cigar2,called1,called2);
            break;
        case OUTPUT_FASTQ:
-           output_fastq(simopt,seqname,cigar1,cigar2,called1,called2);
+           output_fastq(outfp,simopt,seqname,cigar1,cigar2,called1,called2);
            break;
        case OUTPUT_CASAVA:
-           output_fastq(simopt,seqname,cigar1,cigar2,called1,called2);
+           output_fastq(outfp,simopt,seqname,cigar1,cigar2,called1,called2);
            break;
        default:
            errx(EXIT_FAILURE,"Unrecognised format in %s (%s:%d)",__func__,__FILE__,__LINE__);
@@ -799,13 +983,22 @@ struct pair_double correlated_distribution(const real_t threshold, const real_t
 }
 
 
-MAT mix_intensities(const MAT int1, const MAT int2, const real_t prop){
+/* Storage from arena for a matrix the same shape as mat, NULL if mat is */
+static MAT new_MAT_like_ARENA( ARENA arena, const MAT mat){
+    return (NULL!=mat) ? new_MAT_ARENA(arena,mat->nrow,mat->ncol) : NULL;
+}
+
+/* Mixture of two sets of intensities, stored in intmix if not NULL */
+MAT mix_intensities(const MAT int1, const MAT int2, const real_t prop, MAT intmix){
     if(NULL==int1 || NULL==int2){ return NULL;}
     validate(int1->nrow==int2->nrow && int1->ncol==int2->ncol,NULL);
     validate(isprob(prop),NULL);
 
-    MAT intmix = new_MAT(int1->nrow,int1->ncol);
-    if(NULL==intmix){ return NULL;}
+    if(NULL==intmix){
+        intmix = new_MAT(int1->nrow,int1->ncol);
+        if(NULL==intmix){ return NULL;}
+    }
+    validate(intmix->nrow*intmix->ncol==int1->nrow*int1->ncol,NULL);
     
     const uint32_t nelt = int1->nrow * int1->ncol;
     for ( uint32_t i=0 ; i<nelt ; i++){
@@ -817,21 +1010,55 @@ MAT mix_intensities(const MAT int1, const MAT int2, const real_t prop){
 MAT random_mix_intensities(const MAT int1, const MAT int2, const real_t shape1, const real_t shape2){
     if(NULL==int1 || NULL==int2){ return NULL;}
     real_t prop = rkumaraswamy(shape1,shape2);
-    return mix_intensities(int1,int2,prop);
+    return mix_intensities(int1,int2,prop,NULL);
 }
 
     
-CALLED process_intensities( MAT intensities, const real_t lambda, const MAT * invchol, const SIMOPT simopt){
-    CALLED cl = calloc(1,sizeof(*cl));
+/* Compare likelihoods against those calculated using lss for every base */
+void check_likelihood( const MAT loglike, const real_t lambda, const MAT intensities, const real_t * invchol, const SIMOPT simopt){
+    MAT ref = likelihood_cycle_intensities(simopt->sdfact,simopt->mu,lambda,intensities,invchol,NULL,NULL);
+    if(NULL==ref){ return; }
+    for ( uint32_t i=0 ; i<ref->nrow*ref->ncol ; i++){
+        if( fabs(loglike->x[i]-ref->x[i]) > 1e-8*(1.0+fabs(ref->x[i])) ){
+            warnx("Likelihood for cycle %u, base %u differs from reference: %e != %e",i/NBASE+1,i%NBASE,loglike->x[i],ref->x[i]);
+        }
+    }
+    free_MAT(ref);
+}
+    
+/* Call bases and qualities from intensities. If arena is not NULL, all
+ * storage for the result comes from it and the result must not be passed to
+ * free_CALLED; intensities should then also belong to the arena.
+ */
+CALLED process_intensities( MAT intensities, const real_t lambda, const real_t * invchol, const MAT prec, const SIMOPT simopt, ARENA arena){
+    CALLED cl = (NULL!=arena) ? alloc_ARENA(arena,sizeof(*cl)) : calloc(1,sizeof(*cl));
     if(NULL==cl){ return NULL;}
     cl->intensities = intensities;
-    cl->loglike = likelihood_cycle_intensities(simopt->sdfact,simopt->mu,lambda,intensities,invchol,NULL);
-    cl->calls = call_by_maximum_likelihood(cl->loglike,cl->calls);
-    cl->quals = quality_from_likelihood(cl->loglike,cl->calls,simopt->generr,simopt->illumina,cl->quals);
+    const bool need_like = (OUTPUT_LIKE==simopt->format || simopt->check_likelihood || NULL==prec);
+    if(NULL!=arena && NULL!=intensities){
+        const uint32_t ncycle = intensities->ncol;
+        cl->calls = new_ARRAY_ARENA(NUC,arena,ncycle);
+        cl->quals = new_ARRAY_ARENA(PHREDCHAR,arena,ncycle);
+        if(need_like){ cl->loglike = new_MAT_ARENA(arena,NBASE,ncycle); }
+    }
+    if(!need_like){
+        // Likelihoods not required for output
+        call_cycle_intensities(simopt->sdfact,simopt->mu,lambda,intensities,prec,simopt->generr,simopt->illumina,&cl->calls,&cl->quals);
+    } else {
+        cl->loglike = likelihood_cycle_intensities(simopt->sdfact,simopt->mu,lambda,intensities,invchol,prec,cl->loglike);
+        if(simopt->check_likelihood){ check_likelihood(cl->loglike,lambda,intensities,invchol,simopt); }
+        cl->calls = call_by_maximum_likelihood(cl->loglike,cl->calls);
+        cl->quals = quality_from_likelihood(cl->loglike,cl->calls,simopt->generr,simopt->illumina,cl->quals);
+    }
     cl->pass_filter = number_inpure_cycles(intensities,simopt->purity_threshold,simopt->purity_cycles) <= simopt->purity_max;
     if(simopt->dumpRaw){
-        cl->intensities = unprocess_intensities(cl->intensities,simopt->At, simopt->N, NULL);
-	free_MAT(intensities);
+        if(NULL!=arena){
+            MAT raw = (NULL!=intensities) ? new_MAT_ARENA(arena,intensities->nrow,intensities->ncol) : NULL;
+            cl->intensities = unprocess_intensities(cl->intensities,simopt->At, simopt->N, raw);
+        } else {
+            cl->intensities = unprocess_intensities(cl->intensities,simopt->At, simopt->N, NULL);
+            free_MAT(intensities);
+        }
     }
     return cl;
 }
@@ -868,8 +1095,10 @@ CALLED reverse_complement_CALLED( const CALLED called){
 	if(revqual.elt==NULL){ goto cleanup;}
 	rcintensities = reverse_complement_MAT(called->intensities);
 	if(rcintensities==NULL){ goto cleanup;}
-	rcloglike = reverse_complement_MAT(called->loglike);
-	if(rcloglike==NULL){ goto cleanup;}
+	if(NULL!=called->loglike){
+		rcloglike = reverse_complement_MAT(called->loglike);
+		if(rcloglike==NULL){ goto cleanup;}
+	}
 	
 	// Create new CALLED object
 	called_new = calloc(1,sizeof(*called_new));
@@ -909,11 +1138,284 @@ void update_error_counts(const ARRAY(NUC) calls, const ARRAY(NUC) seq, uint32_t
     errorhist[(nerr<6)?nerr:6]++;
 }
 
+/* Sequence and cigar strings for a read, before any random numbers are drawn.
+ * Index is the position of the read in the input. All storage for the read
+ * comes from arena, which the name and bases of read should already be in.
+ */
+SEQSTR new_SEQSTR( const ARENASEQ * read, const uint64_t idx, const MODEL model, const SIMOPT simopt, ARENA arena){
+    validate(NULL!=read,NULL);
+    validate(NULL!=arena,NULL);
+    SEQSTR seqstr = alloc_ARENA(arena,sizeof(*seqstr));
+    validate(NULL!=seqstr,NULL);
+    seqstr->arena = arena;
+    seqstr->name = read->name;
+    seqstr->seq = read->seq;
+    seqstr->paired = model->paired;
+    seqstr->idx = idx;
+
+    // No cigar strings for standard CASAVA 1.8 FASTQ format
+    if(simopt->format == OUTPUT_CASAVA) {
+        seqstr->cigar2 = null_CIGLIST;
+        seqstr->cigar1 = null_CIGLIST;
+    } else {
+        seqstr->cigar1 = sub_cigar_ARENA(read->cigar,model->ncycle,arena);
+        seqstr->cigar2 = null_CIGLIST;
+    }
+    if ( model->paired){
+        const uint32_t len = seqstr->seq.nelt;
+        seqstr->rcseq = new_ARRAY_ARENA(NUC,arena,len);
+        for ( uint32_t i=0 ; i<len ; i++){
+            seqstr->rcseq.elt[i] = complement(seqstr->seq.elt[len-i-1]);
+        }
+        CIGLIST revcig = reverse_cigar_view(read->cigar);
+        seqstr->cigar2 = sub_cigar_ARENA(revcig,model->ncycle,arena);
+    }
+    return seqstr;
+}
+
+/* Draw brightness and intensities for read. If rng is not NULL, it should be
+ * the current stream and is positioned at the substreams for the read.
+ */
+void generate_SEQSTR( SEQSTR seqstr, const MODEL model, const SIMOPT simopt, RNGSTREAM rng){
+    validate(NULL!=seqstr,);
+    // Pick copula
+    if(NULL!=rng){ seek_RNGSTREAM(rng,seqstr->idx,RNG_SUB_READ); }
+    struct pair_double lambda = correlated_distribution(simopt->threshold,simopt->corr,model->dist1,model->dist2);
+    seqstr->lambda1 = lambda.x1;
+    seqstr->lambda2 = lambda.x2;
+
+    // Generate intensities
+    if(NULL!=rng){ seek_RNGSTREAM(rng,seqstr->idx,RNG_SUB_END1); }
+    MAT ints = new_MAT_ARENA(seqstr->arena,NBASE*model->ncycle,1);
+    seqstr->int1 = generate_pure_intensities(simopt->sdfact,lambda.x1,seqstr->seq,simopt->adapter1,model->ncycle,model->factors1->chol,simopt->dustProb,simopt->invA,simopt->N,ints);
+    if ( model->paired){
+        if(NULL!=rng){ seek_RNGSTREAM(rng,seqstr->idx,RNG_SUB_END2); }
+        ints = new_MAT_ARENA(seqstr->arena,NBASE*model->ncycle,1);
+        seqstr->int2 = generate_pure_intensities(simopt->sdfact,lambda.x2,seqstr->rcseq,simopt->adapter2,model->ncycle,model->factors2->chol,simopt->dustProb,simopt->invA,simopt->N,ints);
+    }
+}
+
+/* State shared by all reads: model, options and the error summary.
+ * Summaries are only updated by write_READJOB, which is called in order
+ * from a single thread.
+ */
+typedef struct {
+    MODEL model;
+    SIMOPT simopt;
+    FILE * intout;
+    // Output for ends and intensities is written by a separate thread.
+    // Index of file for each, -1 if none. Both ends may share a file.
+    ASYNCOUT aout;
+    int outfile[3];
+    uint32_t * error, * error2;
+    uint32_t errorhist[7], errorhist2[7];
+    uint32_t seq_count, unfiltered_count;
+} * SIMSTATE;
+
+/* Work remaining for a read once its intensities have been generated and all
+ * random numbers it needs drawn: calling and formatting of results. When
+ * threaded, the results are formatted into buffers belonging to the job and
+ * appended to the output buffers by the writer, otherwise they are formatted
+ * directly into the output buffers.
+ * Everything allocated for the read comes from the job's arena, which is
+ * reset when the job is next filled.
+ */
+typedef struct {
+    SEQSTR seqstr;
+    ARENA arena;
+    MAT intensities, intensities2;
+    uint32_t x,y;
+    CALLED called1, called2;
+    bool buffered;
+    OUTBUF out[3];
+    bool generate;
+    RNGSTREAM rng;
+} * READJOB;
+
+void free_READJOB( void * arg){
+    READJOB job = arg;
+    if(NULL==job){ return;}
+    if(job->buffered){
+        if(job->out[1]!=job->out[0]){ free_OUTBUF(job->out[1]); }
+        free_OUTBUF(job->out[0]);
+        free_OUTBUF(job->out[2]);
+    }
+    free_RNGSTREAM(job->rng);
+    free_ARENA(job->arena);
+    free(job);
+}
+
+/* Current buffer for output i (ends and intensities), NULL if none */
+static OUTBUF outbuf_SIMSTATE( const SIMSTATE state, const int i){
+    return (state->outfile[i]>=0) ? outbuf_ASYNCOUT(state->aout,state->outfile[i]) : NULL;
+}
+
+void * new_READJOB( void * info){
+    SIMSTATE state = info;
+    READJOB job = calloc(1,sizeof(*job));
+    if(NULL==job){ return NULL;}
+    job->buffered = (state->simopt->nthread>1);
+    job->arena = new_ARENA(ARENA_BLOCKSIZE);
+    if(NULL==job->arena){ goto cleanup; }
+    if(RNG_COUNTER==state->simopt->rng){
+        job->rng = new_RNGSTREAM(state->simopt->seed);
+        if(NULL==job->rng){ goto cleanup; }
+    }
+    if(!job->buffered){ return job; }
+
+    // Mirror sharing of output files so read suffixes are unchanged
+    job->out[0] = new_OUTBUF(JOB_OUTBUF_SIZE);
+    if(NULL==job->out[0]){ goto cleanup; }
+    if(state->outfile[0]==state->outfile[1]){
+        job->out[1] = job->out[0];
+    } else {
+        job->out[1] = new_OUTBUF(JOB_OUTBUF_SIZE);
+        if(NULL==job->out[1]){ goto cleanup; }
+    }
+    if(state->outfile[2]>=0){
+        job->out[2] = new_OUTBUF(JOB_OUTBUF_SIZE);
+        if(NULL==job->out[2]){ goto cleanup; }
+    }
+    return job;
+
+cleanup:
+    free_READJOB(job);
+    return NULL;
+}
+
+void work_READJOB( void * arg, void * info){
+    READJOB job = arg;
+    SIMSTATE state = info;
+    const SEQSTR seqstr = job->seqstr;
+    if(job->buffered){
+        for ( int i=0 ; i<3 ; i++){
+            if(NULL!=job->out[i]){ clear_OUTBUF(job->out[i]); }
+        }
+    } else {
+        // Format directly into output, buffers changing as they are submitted
+        for ( int i=0 ; i<3 ; i++){ job->out[i] = outbuf_SIMSTATE(state,i); }
+    }
+
+    if(job->generate){
+        RNGSTREAM prev = use_RNGSTREAM(job->rng);
+        generate_SEQSTR(seqstr,state->model,state->simopt,job->rng);
+        job->intensities = seqstr->int1;
+        job->intensities2 = seqstr->int2;
+        seek_RNGSTREAM(job->rng,seqstr->idx,RNG_SUB_PLACE);
+        job->x = (uint32_t)( 1794 * runif());
+        job->y = (uint32_t)( 2048 * runif());
+        use_RNGSTREAM(prev);
+    }
+
+    job->called1 = process_intensities(job->intensities,seqstr->lambda1,state->model->factors1->invchol,state->model->prec1,state->simopt,job->arena);
+    const real_t * invchol2 = (NULL!=state->model->factors2) ? state->model->factors2->invchol : NULL;
+    job->called2 = process_intensities(job->intensities2,seqstr->lambda2,invchol2,state->model->prec2,state->simopt,job->arena);
+    job->intensities = job->intensities2 = NULL; // Now referenced by called
+    output_results(job->out[2],job->out,state->simopt,seqstr->name,seqstr->cigar1,seqstr->cigar2,job->x,job->y,job->called1,job->called2);
+}
+
+void write_READJOB( void * arg, void * info){
+    READJOB job = arg;
+    SIMSTATE state = info;
+    if(job->buffered){
+        for ( int i=0 ; i<3 ; i++){
+            if(NULL==job->out[i] || (1==i && job->out[1]==job->out[0])){ continue; }
+            OUTBUF out = outbuf_SIMSTATE(state,i);
+            append_OUTBUF(out,job->out[i]->buf,job->out[i]->len);
+        }
+    }
+    flush_ASYNCOUT(state->aout,false);
+
+    update_error_counts(job->called1->calls,job->seqstr->seq,state->error,state->errorhist);
+    update_error_counts(job->called2->calls,job->seqstr->rcseq,state->error2,state->errorhist2);
+    if(job->called1->pass_filter){ state->unfiltered_count++;}
+
+    // Storage belongs to arena
+    job->called1 = job->called2 = NULL;
+    job->seqstr = NULL;
+
+    state->seq_count++;
+    if( (state->seq_count%1000)==0 ){ fprintf(stderr,"Done: %8u\n",state->seq_count); }
+}
+
+/* Next job to fill, either from the pool or the single job used when
+ * running without threads.
+ */
+static READJOB next_READJOB( POOL pool, READJOB direct){
+    return (NULL!=pool) ? next_job_POOL(pool) : direct;
+}
+
+static void dispatch_READJOB( POOL pool, READJOB job, SIMSTATE state){
+    if(NULL!=pool){
+        submit_POOL(pool);
+    } else {
+        work_READJOB(job,state);
+        write_READJOB(job,state);
+    }
+}
+
+/* Draw coordinates for a read held back until the intensities of the next
+ * have been generated, and dispatch it.
+ */
+static void dispatch_pending( POOL pool, READJOB job, SIMSTATE state){
+    if(NULL==job){ return; }
+    job->x = (uint32_t)( 1794 * runif());
+    job->y = (uint32_t)( 2048 * runif());
+    dispatch_READJOB(pool,job,state);
+}
+
+/* Next read into storage from arena, sampled from the library if there is
+ * one. Returns false at the end of input.
+ */
+static bool next_read( LIBSOURCE library, SEQREADER reader, ARENA arena, ARENASEQ * read){
+    if(NULL==library){
+        return (NULL!=reader) && arenaseq_from_SEQREADER(reader,arena,read);
+    }
+    SEQ seq = next_LIBSOURCE(library);
+    if(NULL==seq){ return false; }
+    read->name = strdup_ARENA(arena,seq->name);
+    read->seq = new_ARRAY_ARENA(NUC,arena,seq->seq.nelt+1);
+    if(NULL==read->name || NULL==read->seq.elt){ errx(EXIT_FAILURE,"Failed to allocate memory for read"); }
+    read->seq.nelt = seq->seq.nelt;
+    memcpy(read->seq.elt,seq->seq.elt,seq->seq.nelt*sizeof(NUC));
+    read->cigar = copy_CIGLIST_ARENA(seq->cigar,arena);
+    free_SEQ(seq);
+    return true;
+}
+
+/* Options for library sampled in-process, split on whitespace and parsed as
+ * simLibrary would.
+ */
+static LIBOPT parse_library( const CSTRING str){
+    char * copy = copy_CSTRING(str);
+    const size_t maxarg = strlen(str)/2 + 2;
+    char ** args = calloc(maxarg,sizeof(*args));
+    if(NULL==copy || NULL==args){ errx(EXIT_FAILURE,"Failed to allocate memory for library options"); }
+    int nargs = 0;
+    args[nargs++] = "simLibrary";
+    for ( char * tok=strtok(copy," \t\n") ; NULL!=tok ; tok=strtok(NULL," \t\n")){
+        args[nargs++] = tok;
+    }
+    optind = 0;  // Reinitialise getopt
+    LIBOPT libopt = parse_LIBOPT(nargs,args);
+    if(NULL==libopt){ errx(EXIT_FAILURE,"Failed to parse library options"); }
+    if(optind<nargs){
+        errx(EXIT_FAILURE,"Unexpected argument \"%s\" in library options. Sequences to sample from follow the runfile.",args[optind]);
+    }
+    if(NULL!=libopt->pack_fn){ errx(EXIT_FAILURE,"Can't pack a reference from library options."); }
+    if(libopt->gzip){ warnx("Fragments of library aren't written, ignoring --gzip in library options."); }
+    if(libopt->binary){ warnx("Fragments of library aren't written, ignoring --fragment-format in library options."); }
+    free(args);
+    free(copy);
+    return libopt;
+}
+
 int main( int argc, char * argv[] ){
     SIMOPT simopt = parse_arguments(argc,argv);
 
     argc -= optind;
     argv += optind;
+    LIBOPT libopt = (NULL!=simopt->library) ? parse_library(simopt->library) : NULL;
     if(0==argc){
         fputs("Expecting runfile on commandline but none found.\n",stderr);
         fprint_usage(stderr);
@@ -927,6 +1429,15 @@ int main( int argc, char * argv[] ){
     }
     argc--;
     argv++;
+    if( NULL!=simopt->compile_fn ){
+        if(!compile_MODEL(model,simopt->compile_fn)){
+            errx(EXIT_FAILURE,"Failed to write compiled runfile \"%s\"",simopt->compile_fn);
+        }
+        fprintf(stderr,"Wrote compiled runfile \"%s\"\n",simopt->compile_fn);
+        free_MODEL(model);
+        free_SIMOPT(simopt);
+        return EXIT_SUCCESS;
+    }
     if( simopt->desc ){
         show_MODEL(stderr,model);
         return EXIT_SUCCESS;
@@ -972,21 +1483,13 @@ int main( int argc, char * argv[] ){
     
     if(model->paired && simopt->paired==PAIRED_TYPE_SINGLE){
         fputs("Treating paired-end model as single-ended.\n",stderr);
-        model->paired = false;
-        free_MAT(model->cov2);
-        model->cov2 = NULL;
+        single_end_MODEL(model);
     } else if(!model->paired && simopt->paired!=PAIRED_TYPE_SINGLE){
         fputs("Treating single-ended model as paired-end.\n",stderr);
-        model->paired = true;
-        model->cov2 = copy_MAT(model->cov1);
-        model->chol2 = copy_MAT(model->chol1);
-        model->invchol2 = calloc(model->ncycle,sizeof(*model->invchol2));
+        share_ends_MODEL(model);
 	if(!model->dist2){
 		model->dist2 = copy_Distribution(model->dist1);
 	}
-        for ( uint32_t i=0 ; i<model->ncycle ; i++){
-            model->invchol2[i] = copy_MAT(model->invchol1[i]);
-        }
     }
 
     if(simopt->ncycle==0){
@@ -997,7 +1500,7 @@ int main( int argc, char * argv[] ){
         fprintf(stderr,"Asked for more cycles than runfile allows. Doing %u.\n",model->ncycle);
     } else {
         MODEL newmodel = trim_MODEL(simopt->ncycle,simopt->final_factor,model);
-        free_MODEL(model);
+        if(newmodel!=model){ free_MODEL(model); }
         model = newmodel; 
     }
 
@@ -1012,13 +1515,13 @@ int main( int argc, char * argv[] ){
     //show_MODEL(stderr,model);
 
     // Scan through fasta file
-    SEQ seq = NULL;
-    uint32_t seq_count=0, unfiltered_count=0;
+    SIMSTATE state = calloc(1,sizeof(*state));
+    if(NULL==state){ errx(EXIT_FAILURE,"Failed to allocate memory for simulation state"); }
+    state->model = model;
+    state->simopt = simopt;
     // Memory for error counting
-    uint32_t * error = calloc(model->ncycle,sizeof(uint32_t));
-    uint32_t * error2 = calloc(model->ncycle,sizeof(uint32_t));
-    uint32_t errorhist[7] = {0,0,0,0,0,0,0};
-    uint32_t errorhist2[7] = {0,0,0,0,0,0,0};
+    state->error = calloc(model->ncycle,sizeof(uint32_t));
+    state->error2 = calloc(model->ncycle,sizeof(uint32_t));
     
     FILE * fpout = (NULL!=simopt->intensity_fn) ? fopen(simopt->intensity_fn,"w") : NULL;
     if ( NULL==fpout && NULL!=simopt->intensity_fn){
@@ -1028,7 +1531,8 @@ int main( int argc, char * argv[] ){
 	    size_t preflen = strlen(simopt->outprefix);
 	    size_t fnlen = preflen;
             if(simopt->paired==PAIRED_TYPE_PAIRED){ fnlen += 5; }
-	    fnlen += (simopt->format==OUTPUT_LIKE)?5:3;
+	    fnlen += (simopt->format==OUTPUT_LIKE)?((0!=simopt->like_bits)?6:5):3;
+	    if(simopt->gzip){ fnlen += 3; }
 
 	    // Create new filename
 	    char fn[1+fnlen];
@@ -1039,11 +1543,15 @@ int main( int argc, char * argv[] ){
 		offset += 5;
 	    }
 	    switch(simopt->format){
-		    case OUTPUT_LIKE: strcpy(fn+offset,".like"); offset+=5; break;
+		    case OUTPUT_LIKE:
+			if(0!=simopt->like_bits){ strcpy(fn+offset,".likeb"); offset+=6; }
+			else { strcpy(fn+offset,".like"); offset+=5; }
+			break;
 		    case OUTPUT_FASTQ: strcpy(fn+offset,".fq"); offset+=3; break;
 		    case OUTPUT_CASAVA: strcpy(fn+offset,".fq"); offset+=3; break;
 		    case OUTPUT_FASTA: strcpy(fn+offset,".fa"); offset+=3; break;
 	    }
+	    if(simopt->gzip){ strcpy(fn+offset,".gz"); offset+=3; }
 	    *(fn+offset) = '\0';
 
 	    if(simopt->paired==PAIRED_TYPE_PAIRED){
@@ -1077,139 +1585,207 @@ int main( int argc, char * argv[] ){
         ambigphred.elt[i] = '!';
     }
 
-    // Circular buffer for intensities. Size one if no buffer.
-    CIRCBUFF(SEQSTR) circbuff = new_circbuff_SEQSTR(simopt->bufflen);
+    // Calling and output, either threaded or directly
+    // All output is through buffers written directly to the underlying files
+    state->intout = fpout;
+    {
+        FILE * fps[3] = { simopt->outfp[0], simopt->outfp[1], fpout };
+        int fd[3];
+        bool compress[3];
+        uint32_t nfile = 0;
+        for ( int i=0 ; i<3 ; i++){
+            state->outfile[i] = -1;
+            if(NULL==fps[i]){ continue; }
+            if(1==i && fps[1]==fps[0]){ state->outfile[1] = state->outfile[0]; continue; }
+            fflush(fps[i]);
+            fd[nfile] = fileno(fps[i]);
+            compress[nfile] = simopt->gzip;
+            state->outfile[i] = nfile++;
+        }
+        state->aout = new_ASYNCOUT(nfile,fd,compress,OUTPUT_BLOCKSIZE,nprocessor());
+        if(NULL==state->aout){ errx(EXIT_FAILURE,"Failed to allocate memory for output"); }
+        if(NULL!=fpout && simopt->binary_intensities){
+            const BINHEADER header = new_BINHEADER(BINFORMAT_INTENSITIES,model->ncycle,model->paired?2:1,simopt->lane,simopt->tile);
+            append_BINHEADER(outbuf_SIMSTATE(state,2),&header);
+        }
+        if(OUTPUT_LIKE==simopt->format && 0!=simopt->like_bits){
+            // One header per file, see output_binary_likelihood
+            const uint32_t nend = (model->paired && PAIRED_TYPE_PAIRED!=simopt->paired)?2:1;
+            const BINHEADER header = new_likelihood_BINHEADER(model->ncycle,nend,simopt->lane,simopt->tile,simopt->like_bits,simopt->like_step);
+            append_BINHEADER(outbuf_SIMSTATE(state,0),&header);
+            if(PAIRED_TYPE_PAIRED==simopt->paired && state->outfile[0]!=state->outfile[1]){ append_BINHEADER(outbuf_SIMSTATE(state,1),&header); }
+        }
+    }
+    POOL pool = NULL;
+    READJOB direct = NULL;
+    if(simopt->nthread>1){
+        const POOL_FUNCS funcs = { new_READJOB, free_READJOB, work_READJOB, write_READJOB };
+        pool = new_POOL(simopt->nthread,16*simopt->nthread,funcs,state);
+        if(NULL==pool){ errx(EXIT_FAILURE,"Failed to create pool of %u threads",simopt->nthread); }
+    } else {
+        direct = new_READJOB(state);
+        if(NULL==direct){ errx(EXIT_FAILURE,"Failed to allocate memory for read"); }
+    }
+
+    // Random numbers for generation on main thread
+    RNGSTREAM rng = (RNG_COUNTER==simopt->rng) ? new_RNGSTREAM(simopt->seed) : NULL;
+    use_RNGSTREAM(rng);
+    // Without jumbling, reads are independent and counter streams allow them
+    // to be generated by the jobs themselves.
+    const bool gen_in_job = (NULL!=rng) && !simopt->jumble;
+    uint64_t read_count = 0;
+
+    // Circular buffer for intensities, only needed when jumbling.
+    // Each buffered read owns an arena. Arenas are handed from a popped read
+    // to the job that processes it, the job's previous arena being reused.
+    CIRCBUFF(SEQSTR) circbuff = simopt->jumble ? new_circbuff_SEQSTR(simopt->bufflen) : NULL;
+    ARENA spare = NULL;
+    // Read whose intensities have been generated, awaiting its coordinates
+    READJOB pending = NULL;
+
+    // Library sampled from the files, rather than reading them as fragments
+    LIBSOURCE library = NULL;
+    if(NULL!=libopt){
+        finish_LIBOPT(libopt);
+        library = new_LIBSOURCE(libopt,argc,argv);
+        if(NULL==library){ errx(EXIT_FAILURE,"Failed to start sampling library"); }
+        argc = 0;
+    }
     FILE * fp = stdin;
     do { // Iterate through filenames
-        if(argc>0){
-            fp = fopen(argv[0],"r");
-            if(NULL==fp){
-                warnx("Failed to open file \"%s\" for input",argv[0]);
+        SEQREADER reader = NULL;
+        if(NULL==library){
+            if(argc>0){
+                fp = fopen(argv[0],"r");
+                if(NULL==fp){
+                    warnx("Failed to open file \"%s\" for input",argv[0]);
+                }
             }
+            reader = (NULL!=fp) ? new_SEQREADER(fp,nprocessor()) : NULL;
         }
-        while (NULL!=fp && (seq=sequence_from_fasta(fp))!=NULL){
-            //show_SEQ(stderr,seq);
-            if (seq->seq.nelt > 0 ){
-
-                SEQSTR seqstr = calloc(1,sizeof(*seqstr));
-            	seqstr->name = copy_CSTRING(seq->name);
-            	seqstr->seq = copy_ARRAY(NUC)(seq->seq);
-            	seqstr->paired = model->paired;
-
-                // No cigar strings for standard CASAVA 1.8 FASTQ format
-                if(simopt->format == OUTPUT_CASAVA) {
-                    seqstr->cigar2 = null_CIGLIST;
-                    seqstr->cigar1 = null_CIGLIST;
-                } else {
-                    seqstr->cigar1 = sub_cigar(seq->cigar,model->ncycle);
-                    seqstr->cigar2 = null_CIGLIST;
+        while ( true ){
+            // Reads are converted straight into the storage they will occupy,
+            // that of the job if it generates the read and otherwise spare.
+            READJOB job = gen_in_job ? next_READJOB(pool,direct) : NULL;
+            if(!gen_in_job && NULL==spare){
+                spare = new_ARENA(ARENA_BLOCKSIZE);
+                if(NULL==spare){ errx(EXIT_FAILURE,"Failed to allocate memory for read"); }
+            }
+            ARENA arena = gen_in_job ? job->arena : spare;
+            reset_ARENA(arena);
+            ARENASEQ read;
+            if(!next_read(library,reader,arena,&read)){ break; }
+            if (read.seq.nelt > 0 ){
+
+                if( gen_in_job ){
+                    // Each read has its own streams so can be generated anywhere
+                    job->seqstr = new_SEQSTR(&read,read_count++,model,simopt,arena);
+                    job->generate = true;
+                    dispatch_READJOB(pool,job,state);
+                    continue;
+                }
+                SEQSTR seqstr = new_SEQSTR(&read,read_count++,model,simopt,spare);
+                spare = NULL;
+                generate_SEQSTR(seqstr,model,simopt,rng);
+                if( !simopt->jumble ){
+                    // Coordinates of the pending read are drawn after the
+                    // intensities of this one, preserving the order of random
+                    // numbers from when every read passed through a buffer.
+                    // Intensities go straight to calling in the read's storage.
+                    dispatch_pending(pool,pending,state);
+                    pending = next_READJOB(pool,direct);
+                    pending->generate = false;
+                    spare = pending->arena;
+                    pending->arena = seqstr->arena;
+                    pending->seqstr = seqstr;
+                    pending->intensities  = seqstr->int1;
+                    pending->intensities2 = seqstr->int2;
+                    continue;
                 }
-            	// Pick copula
-            	struct pair_double lambda = correlated_distribution(simopt->threshold,simopt->corr,model->dist1,model->dist2);
-            	seqstr->lambda1 = lambda.x1;
-            	seqstr->lambda2 = lambda.x2;
-
-            	// Generate intensities
-            	seqstr->int1 = generate_pure_intensities(simopt->sdfact,lambda.x1,seqstr->seq,simopt->adapter1,model->ncycle,model->chol1_cycle,simopt->dustProb,simopt->invA,simopt->N,NULL);
-            	if ( model->paired){
-            	    seqstr->rcseq = reverse_complement(seqstr->seq);
-		    CIGLIST revcig = reverse_cigar(seq->cigar);
-                    seqstr->cigar2 = sub_cigar(revcig,model->ncycle);
-		    free_CIGLIST(revcig);
-                    seqstr->int2 = generate_pure_intensities(simopt->sdfact,lambda.x2,seqstr->rcseq,simopt->adapter2,model->ncycle,model->chol2_cycle,simopt->dustProb,simopt->invA,simopt->N,NULL);
-            	}
-		free_SEQ(seq); seq=NULL;
             	// Store in buffer
             	SEQSTR popped = push_circbuff_SEQSTR(circbuff,seqstr);
             	if( NULL!=popped ){
-                    MAT intensities=NULL,intensities2=NULL;
-                    CALLED called1=NULL, called2=NULL;
+                    READJOB job = next_READJOB(pool,direct);
+                    job->generate = false;
+                    // Job takes ownership of read's storage, its own becoming spare
+                    spare = job->arena;
+                    job->arena = popped->arena;
+                    if(NULL!=rng){ seek_RNGSTREAM(rng,popped->idx,RNG_SUB_PLACE); }
 
                     // Can only pop when buffer is full
-                    if( simopt->jumble ){
-                        real_t prop = rkumaraswamy(simopt->a,simopt->b);
-                    	uint32_t randelt = (uint32_t)(circbuff->maxelt*runif());
-                    	assert(randelt>=0 && randelt<circbuff->maxelt);
-                    	intensities  = mix_intensities(popped->int1,circbuff->elt[randelt]->int1,prop);
-                    	intensities2 = mix_intensities(popped->int2,circbuff->elt[randelt]->int2,prop);
-                    } else {
-                        intensities  = copy_MAT(popped->int1);
-                    	intensities2 = copy_MAT(popped->int2);
-                    }
+                    real_t prop = rkumaraswamy(simopt->a,simopt->b);
+                    uint32_t randelt = (uint32_t)(circbuff->maxelt*runif());
+                    assert(randelt>=0 && randelt<circbuff->maxelt);
+                    job->intensities  = mix_intensities(popped->int1,circbuff->elt[randelt]->int1,prop,new_MAT_like_ARENA(job->arena,popped->int1));
+                    job->intensities2 = mix_intensities(popped->int2,circbuff->elt[randelt]->int2,prop,new_MAT_like_ARENA(job->arena,popped->int2));
             
-                    called1 = process_intensities(intensities,popped->lambda1,model->invchol1,simopt);
-                    update_error_counts(called1->calls,popped->seq,error,errorhist);
-            
-                    called2 = process_intensities(intensities2,popped->lambda2,model->invchol2,simopt);
-                    update_error_counts(called2->calls,popped->rcseq,error2,errorhist2);
-            
-                    if(called1->pass_filter){ unfiltered_count++;}
-                    uint32_t x = (uint32_t)( 1794 * runif());
-                    uint32_t y = (uint32_t)( 2048 * runif());
-                    output_results(fpout,simopt,popped->name,popped->cigar1,popped->cigar2,x,y,called1,called2);
-            
-                    free_CALLED(called1); called1=NULL; intensities=NULL;
-                    free_CALLED(called2); called2=NULL; intensities2=NULL;
-                    free_SEQSTR(popped);
-
-                    seq_count++;
-                    if( (seq_count%1000)==0 ){ fprintf(stderr,"Done: %8u\n",seq_count); }
+                    // Calling uses no random numbers, so coordinates can be drawn now
+                    job->x = (uint32_t)( 1794 * runif());
+                    job->y = (uint32_t)( 2048 * runif());
+                    job->seqstr = popped;
+                    dispatch_READJOB(pool,job,state);
 		}
             } else {
-                warnx("Skipping empty sequence \"%s\"",seq->name);
+                warnx("Skipping empty sequence \"%s\"",read.name);
             }
         }
-        fclose(fp);
+        if(NULL!=reader){ free_SEQREADER(reader); }
+        if(NULL==library && NULL!=fp){ fclose(fp); }
         argc--;
         argv++;
     } while(argc>0);
+    if(NULL!=library){
+        free_LIBSOURCE(library);
+        free_LIBOPT(libopt);
+    }
+    dispatch_pending(pool,pending,state);
     // Buffer still contains (upto) simopt->bufflen elements Output.
-    {
-        MAT intensities=NULL,intensities2=NULL;
-        CALLED called1=NULL, called2=NULL;
+    if(NULL!=circbuff){
         uint32_t maxelt = (circbuff->maxelt<circbuff->nseen)?circbuff->maxelt:circbuff->nseen;
         uint32_t oldest = (circbuff->maxelt<circbuff->nseen)?(circbuff->nseen%circbuff->maxelt):0;
         for ( uint32_t i=0 ; i<maxelt ; i++){
             uint32_t idx = (i+oldest)%circbuff->maxelt;
             SEQSTR popped = circbuff->elt[idx];
-            if( simopt->jumble ){
-                real_t prop = rkumaraswamy(simopt->a,simopt->b);
-                uint32_t randelt = idx;
-                do {
-                    randelt = (uint32_t)(maxelt*runif());
-                } while(randelt==idx);
-                assert(randelt>=0 && randelt<maxelt);
-                intensities  = mix_intensities(popped->int1,circbuff->elt[randelt]->int1,prop);
-                intensities2 = mix_intensities(popped->int2,circbuff->elt[randelt]->int2,prop);
-            } else {
-                intensities  = copy_MAT(popped->int1);
-                intensities2 = copy_MAT(popped->int2);
-            }
-
-            called1 = process_intensities(intensities,popped->lambda1,model->invchol1,simopt);
-            update_error_counts(called1->calls,popped->seq,error,errorhist);
-
-            called2 = process_intensities(intensities2,popped->lambda2,model->invchol2,simopt);
-            update_error_counts(called2->calls,popped->rcseq,error2,errorhist2);
-
-            if(called1->pass_filter){ unfiltered_count++;}
-            uint32_t x = (uint32_t)( 1794 * runif());
-            uint32_t y = (uint32_t)( 2048 * runif());
-            output_results(fpout,simopt,popped->name,popped->cigar1,popped->cigar2,x,y,called1,called2);
-
-            free_CALLED(called1); called1=NULL; intensities=NULL;
-            free_CALLED(called2); called2=NULL; intensities2=NULL;
-
-            seq_count++;
-            if( (seq_count%1000)==0 ){ fprintf(stderr,"Done: %8u\n",seq_count); }
+            READJOB job = next_READJOB(pool,direct);
+            job->generate = false;
+            reset_ARENA(job->arena);
+            if(NULL!=rng){ seek_RNGSTREAM(rng,popped->idx,RNG_SUB_PLACE); }
+            real_t prop = rkumaraswamy(simopt->a,simopt->b);
+            uint32_t randelt = idx;
+            do {
+                randelt = (uint32_t)(maxelt*runif());
+            } while(randelt==idx);
+            assert(randelt>=0 && randelt<maxelt);
+            job->intensities  = mix_intensities(popped->int1,circbuff->elt[randelt]->int1,prop,new_MAT_like_ARENA(job->arena,popped->int1));
+            job->intensities2 = mix_intensities(popped->int2,circbuff->elt[randelt]->int2,prop,new_MAT_like_ARENA(job->arena,popped->int2));
+
+            job->x = (uint32_t)( 1794 * runif());
+            job->y = (uint32_t)( 2048 * runif());
+            // Remaining reads may be mixed with this one, so read stays in
+            // its own storage until all are written
+            job->seqstr = popped;
+            dispatch_READJOB(pool,job,state);
         }
     }
+    // Wait for all reads to be written
+    if(NULL!=pool){ free_POOL(pool); }
+    free_READJOB(direct);
+    free_RNGSTREAM(rng);
+    finish_ASYNCOUT(state->aout);
+    if(simopt->output_stats){ show_ASYNCOUT(stderr,state->aout); }
+    free_ASYNCOUT(state->aout);
     // Empty and free buffer
-    for ( uint32_t i=0 ; i<circbuff->maxelt ; i++){
-        free_SEQSTR(circbuff->elt[i]);
+    if(NULL!=circbuff){
+        for ( uint32_t i=0 ; i<circbuff->maxelt ; i++){
+            if(NULL!=circbuff->elt[i]){ free_ARENA(circbuff->elt[i]->arena); }
+        }
+        free_circbuff_SEQSTR(circbuff);
     }
-    free_circbuff_SEQSTR(circbuff);
+    free_ARENA(spare);
     
+    const uint32_t seq_count = state->seq_count, unfiltered_count = state->unfiltered_count;
+    uint32_t * error = state->error, * error2 = state->error2;
+    uint32_t * errorhist = state->errorhist, * errorhist2 = state->errorhist2;
     fprintf(stderr,"Finished generating %8u sequences\n",seq_count);
     if(simopt->purity_cycles>0){ fprintf(stderr,"%8u sequences passed filter.\n",unfiltered_count);}
     if(NULL!=fpout){fclose(fpout);}
@@ -1243,6 +1819,7 @@ int main( int argc, char * argv[] ){
         fprintf(stderr,"\t %7u %6.2f",errorhist2[6],(100.0*errorhist2[6])/unfiltered_count);
     }
     fputc('\n',stderr);
+    free(state);
     free_MODEL(model);
     free_SIMOPT(simopt);
 
@@ -0,0 +1,149 @@
+/*
+ *  Copyright (C) 2026 the simNGS contributors
+ *
+ *  This file is part of the simNGS software for simulating likelihoods
+ *  for next-generation sequencing machines.
+ *
+ *  simNGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  simNGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with simNGS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <err.h>
+#include "utility.h"
+#include "nuc.h"
+#include "outbuf.h"
+#include "binformat.h"
+
+#define PROGNAME "simNGSconvert"
+#define PROGVERSION "1.0"
+#define OUTPUT_BLOCKSIZE (1<<20)
+
+void fprint_usage( FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+"\t\"" PROGNAME "\"\n"
+"Convert binary output of simNGS to text\n"
+"\n"
+"Usage:\n"
+"\t" PROGNAME " [file.bin ...]\n"
+"\t" PROGNAME " --help\n"
+"\t" PROGNAME " --licence\n"
+"\t" PROGNAME " --version\n"
+PROGNAME " reads from files specified, or stdin if none are given, and writes\n"
+"the text format that simNGS would have written to stdout.\n"
+"\n"
+"Example:\n"
+"\tsimNGS -i ints.bin --intensity-format binary runfile lib.fa > reads.fq\n"
+"\t" PROGNAME " ints.bin > ints.txt\n"
+"\tsimNGS -o likelihood --likelihood-format binary runfile lib.fa > reads.likeb\n"
+"\t" PROGNAME " reads.likeb > reads.like\n"
+,fp);
+}
+
+void fprint_licence(FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+"  " PROGNAME " software for converting binary output of simNGS\n"
+#include "copyright.inc"
+    ,fp);
+}
+
+void fprint_version(FILE * fp){
+    validate(NULL!=fp,);
+    fputs(
+"  " PROGNAME " software for converting binary output of simNGS\n"
+"Version " PROGVERSION " (compiled: " __DATE__ " using " __VERSION__ ")\n"
+, fp);
+}
+
+static struct option longopts[] = {
+    { "help",       no_argument,       NULL, 'h'},
+    { "licence",    no_argument,       NULL, 0 },
+    { "license",    no_argument,       NULL, 0 },
+    { "version",    no_argument,       NULL, 1 },
+    { NULL, 0 , NULL, 0}
+};
+
+static bool convert( FILE * fp, const char * fn, OUTBUF out){
+    BINHEADER header;
+    if(!read_BINHEADER(fp,&header)){
+        warnx("\"%s\" is not a binary file from simNGS, or of an unsupported version",fn);
+        return false;
+    }
+    char * rec = malloc(header.recsize);
+    if(NULL==rec){ errx(EXIT_FAILURE,"Failed to allocate memory for record"); }
+    while(1==fread(rec,header.recsize,1,fp)){
+        append_text_BINFORMAT(out,&header,rec);
+        if(out->len>=OUTPUT_BLOCKSIZE && !write_OUTBUF(out,STDOUT_FILENO)){
+            err(EXIT_FAILURE,"Failed to write output");
+        }
+    }
+    free(rec);
+    if(ferror(fp) || !feof(fp)){ warnx("Error reading \"%s\"",fn); return false; }
+    return true;
+}
+
+int main( int argc, char * argv[] ){
+    int ch;
+    while ((ch = getopt_long(argc, argv, "h", longopts, NULL)) != -1){
+        switch(ch){
+        case 'h':
+            fprint_usage(stderr);
+            exit(EXIT_SUCCESS);
+        case 0:
+            fprint_licence(stderr);
+            exit(EXIT_SUCCESS);
+        case 1:
+            fprint_version(stderr);
+            exit(EXIT_SUCCESS);
+        default:
+            fprint_usage(stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    OUTBUF out = new_OUTBUF(OUTPUT_BLOCKSIZE+OUTPUT_BLOCKSIZE/2);
+    if(NULL==out){ errx(EXIT_FAILURE,"Failed to allocate memory for output"); }
+    bool success = true;
+    FILE * fp = stdin;
+    const char * fn = "stdin";
+    do { // Iterate through filenames
+        if(argc>0){
+            fn = argv[0];
+            fp = fopen(fn,"rb");
+            if(NULL==fp){
+                warnx("Failed to open file \"%s\" for input",fn);
+            }
+        }
+        if(NULL!=fp){
+            success &= convert(fp,fn,out);
+            fclose(fp);
+        } else {
+            success = false;
+        }
+        argc--;
+        argv++;
+    } while(argc>0);
+    if(!write_OUTBUF(out,STDOUT_FILENO)){ err(EXIT_FAILURE,"Failed to write output"); }
+    free_OUTBUF(out);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
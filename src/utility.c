@@ -25,6 +25,8 @@
 #include <string.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <math.h>
 #include "utility.h"
 
 bool isprob( const real_t p){
@@ -186,3 +188,73 @@ int skipUntilChar ( FILE * fp, const char c){
    return n;
 }
 
+/*  Number of processors online, at least one */
+uint32_t nprocessor(void){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n>0) ? (uint32_t)n : 1;
+}
+
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define NEXACT_POW10 (sizeof(exact_pow10)/sizeof(exact_pow10[0]))
+
+static inline bool scale_pow10( const double x, const int k, double * s){
+    if(k>=0 && k<(int)NEXACT_POW10){ *s = x * exact_pow10[k]; return true; }
+    if(k<0 && -k<(int)NEXACT_POW10){ *s = x / exact_pow10[-k]; return true; }
+    return false;
+}
+
+/*  Format x identically to printf's "%e" (seven significant digits) into buf,
+ *  which must have space for REAL_E_MAXLEN+1 characters, returning the
+ *  number of characters written excluding the terminating nul.
+ *  The significand is found by one correctly rounded scaling by an exact
+ *  power of ten, so its error is far less than the rounding tolerance used;
+ *  values close to a tie, non-finite values and those needing larger powers
+ *  of ten are left to snprintf so results always agree with the C library.
+ */
+uint32_t format_real_e( char * buf, const double x){
+    if(!isfinite(x)){ goto fallback; }
+    char * ptr = buf;
+    double ax = x;
+    if(signbit(x)){ *ptr++ = '-'; ax = -x; }
+
+    uint32_t m = 0;
+    int e10 = 0;
+    if(ax!=0.0){
+        // Estimate of decimal exponent from binary, possibly one too small
+        e10 = (int)floor(ilogb(ax)*0.30102999566398120);
+        double s;
+        if(!scale_pow10(ax,6-e10,&s)){ goto fallback; }
+        if(s>=1e7){
+            e10++;
+            if(!scale_pow10(ax,6-e10,&s)){ goto fallback; }
+        }
+        const uint32_t fl = (uint32_t)s;
+        const double frac = s - fl;
+        if(fabs(frac-0.5)<1e-6){ goto fallback; }
+        m = fl + (frac>0.5);
+        if(m>=10000000){ m /= 10; e10++; }
+        if(m<1000000){ goto fallback; }
+    }
+
+    ptr[0] = '0' + m/1000000;
+    ptr[1] = '.';
+    for ( int i=7 ; i>1 ; i--){
+        ptr[i] = '0' + m%10;
+        m /= 10;
+    }
+    ptr += 8;
+    *ptr++ = 'e';
+    *ptr++ = (e10<0)?'-':'+';
+    uint32_t ae = (e10<0)?-e10:e10;
+    if(ae>=100){ *ptr++ = '0' + ae/100; ae %= 100; }
+    *ptr++ = '0' + ae/10;
+    *ptr++ = '0' + ae%10;
+    *ptr = '\0';
+    return ptr - buf;
+
+fallback:
+    return snprintf(buf,REAL_E_MAXLEN+1,"%e",x);
+}
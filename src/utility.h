@@ -132,5 +132,10 @@ void show_CSTRING(FILE *fp, const CSTRING cstr);
 CSTRING read_CSTRING(FILE *fp);
 
 int skipUntilChar ( FILE * fp, const char c);
+uint32_t nprocessor(void);
+
+/* Longest string written by format_real_e, excluding terminating nul */
+#define REAL_E_MAXLEN 15
+uint32_t format_real_e( char * buf, const double x);
 
 #endif